@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 199309L
+
 #include "fast.h"
 #include "fast_internal.h"
 #include <assert.h>
@@ -13,6 +15,8 @@ static const uint8_t BENCH_TWEAK[BENCH_TWEAK_LEN] = {
 
 #define BENCHMARK_ITERATIONS 10000
 #define WARMUP_ITERATIONS    1000
+#define MODARITH_LAYERS      4000000
+#define MODARITH_WORD_LENGTH 16
 
 typedef struct {
     double encrypt_time;
@@ -180,6 +184,101 @@ benchmark_data_sizes()
     }
 }
 
+// Previous division-based modular arithmetic, kept for comparison
+static inline uint8_t
+div_mod_add(uint32_t a, uint32_t b, uint32_t radix)
+{
+    return (uint8_t) ((a + b) % radix);
+}
+
+static inline uint8_t
+div_mod_sub(uint32_t a, uint32_t b, uint32_t radix)
+{
+    return (uint8_t) ((a + radix - (b % radix)) % radix);
+}
+
+// Runs MODARITH_LAYERS encryption layers (w = 4, w' = 3) over a rotating word
+static inline uint32_t
+run_modarith_layers(const uint8_t *perm, uint32_t radix, bool use_division)
+{
+    const uint32_t ell = MODARITH_WORD_LENGTH;
+    uint8_t        data[MODARITH_WORD_LENGTH];
+
+    for (uint32_t i = 0; i < ell; i++) {
+        data[i] = (uint8_t) (i % radix);
+    }
+
+    for (uint32_t base = 0; base < MODARITH_LAYERS; base += ell) {
+        for (uint32_t j = 0; j < ell; j++) {
+            uint8_t x0 = data[j];
+            uint8_t y  = data[(j + ell - 3) % ell];
+            uint8_t xw = data[(j + 4) % ell];
+            uint8_t s;
+            if (use_division) {
+                s       = perm[div_mod_add(x0, y, radix)];
+                data[j] = perm[div_mod_sub(s, xw, radix)];
+            } else {
+                s       = perm[mod_add(x0, y, radix)];
+                data[j] = perm[mod_sub(s, xw, radix)];
+            }
+        }
+    }
+
+    uint32_t checksum = 0;
+    for (uint32_t i = 0; i < ell; i++) {
+        checksum = checksum * 31 + data[i];
+    }
+    return checksum;
+}
+
+static uint32_t
+run_modarith_division(const uint8_t *perm, uint32_t radix)
+{
+    return run_modarith_layers(perm, radix, true);
+}
+
+static uint32_t
+run_modarith_conditional(const uint8_t *perm, uint32_t radix)
+{
+    return run_modarith_layers(perm, radix, false);
+}
+
+static void
+benchmark_modular_arithmetic()
+{
+    printf("\n=== Benchmarking Modular Arithmetic (word length %d) ===\n", MODARITH_WORD_LENGTH);
+    printf("%-10s %-22s %-22s %-10s\n", "Radix", "Division(ns/layer)", "Conditional(ns/layer)",
+           "Speedup");
+    printf("-------------------------------------------------------------------\n");
+
+    static const uint32_t radices[] = { 10, 26, 36, 62 };
+
+    for (size_t i = 0; i < sizeof(radices) / sizeof(radices[0]); i++) {
+        // Read the radix through a volatile so that neither variant is specialized for it
+        volatile uint32_t radix_v = radices[i];
+        uint32_t          radix   = radix_v;
+        uint8_t           perm[FAST_MAX_RADIX];
+
+        // 7 is coprime with every benchmarked radix, so this is a permutation
+        for (uint32_t j = 0; j < radix; j++) {
+            perm[j] = (uint8_t) ((j * 7 + 3) % radix);
+        }
+
+        double   start        = get_time_seconds();
+        uint32_t sum_division = run_modarith_division(perm, radix);
+        double   division     = (get_time_seconds() - start) / MODARITH_LAYERS;
+
+        start                    = get_time_seconds();
+        uint32_t sum_conditional = run_modarith_conditional(perm, radix);
+        double   conditional     = (get_time_seconds() - start) / MODARITH_LAYERS;
+
+        assert(sum_division == sum_conditional);
+
+        printf("%-10u %-22.2f %-22.2f %-10.2f\n", radix, division * 1e9, conditional * 1e9,
+               division / conditional);
+    }
+}
+
 static void
 benchmark_operations_per_second()
 {
@@ -225,6 +324,106 @@ benchmark_operations_per_second()
     fast_cleanup(ctx);
 }
 
+#define BATCH_WORDS 4096
+
+void
+benchmark_batch_throughput()
+{
+    printf("\n=== Batch Throughput (radix 10, length 16, %d words per call) ===\n", BATCH_WORDS);
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88,
+                                       0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00 };
+
+    fast_params_t params;
+    assert(calculate_recommended_params(&params, 10, 16) == 0);
+
+    fast_context_t *ctx;
+    assert(fast_init(&ctx, &params, key) == 0);
+
+    uint8_t *words = malloc((size_t) BATCH_WORDS * 16);
+    assert(words);
+    for (size_t i = 0; i < (size_t) BATCH_WORDS * 16; i++) {
+        words[i] = (uint8_t) (rand() % 10);
+    }
+
+    double start        = get_time_seconds();
+    double end          = start + 1.0;
+    long   single_words = 0;
+
+    while (get_time_seconds() < end) {
+        for (size_t i = 0; i < BATCH_WORDS; i++) {
+            fast_encrypt(ctx, BENCH_TWEAK, BENCH_TWEAK_LEN, words + i * 16, words + i * 16, 16);
+        }
+        single_words += BATCH_WORDS;
+    }
+    double single_time = get_time_seconds() - start;
+
+    start            = get_time_seconds();
+    end              = start + 1.0;
+    long batch_words = 0;
+
+    while (get_time_seconds() < end) {
+        fast_encrypt_batch(ctx, BENCH_TWEAK, BENCH_TWEAK_LEN, words, words, 16, BATCH_WORDS);
+        batch_words += BATCH_WORDS;
+    }
+    double batch_time = get_time_seconds() - start;
+
+    printf("fast_encrypt:       %.0f words/s\n", single_words / single_time);
+    printf("fast_encrypt_batch: %.0f words/s\n", batch_words / batch_time);
+
+    free(words);
+    fast_cleanup(ctx);
+}
+
+static void
+benchmark_long_messages()
+{
+    printf("\n=== Long Messages (radix 10, 1024 symbols) ===\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0xAA, 0x99, 0x88,
+                                       0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00 };
+    uint8_t message[1024];
+    for (size_t i = 0; i < sizeof(message); i++) {
+        message[i] = (uint8_t) (rand() % 10);
+    }
+
+    // One 1024-symbol word, against 16-symbol blocks in the long-message mode
+    fast_params_t   word_params, block_params;
+    fast_context_t *word_ctx, *block_ctx;
+    assert(calculate_recommended_params(&word_params, 10, sizeof(message)) == 0);
+    assert(calculate_recommended_params(&block_params, 10, 16) == 0);
+    assert(fast_init(&word_ctx, &word_params, key) == 0);
+    assert(fast_init(&block_ctx, &block_params, key) == 0);
+
+    const char *names[] = { "fast_encrypt (1 word)", "fast_encrypt_long", "fast_decrypt_long" };
+    for (int mode = 0; mode < 3; mode++) {
+        double start = get_time_seconds();
+        double end   = start + 1.0;
+        long   calls = 0;
+
+        while (get_time_seconds() < end) {
+            if (mode == 0) {
+                fast_encrypt(word_ctx, BENCH_TWEAK, BENCH_TWEAK_LEN, message, message,
+                             sizeof(message));
+            } else if (mode == 1) {
+                fast_encrypt_long(block_ctx, BENCH_TWEAK, BENCH_TWEAK_LEN, message, message,
+                                  sizeof(message));
+            } else {
+                fast_decrypt_long(block_ctx, BENCH_TWEAK, BENCH_TWEAK_LEN, message, message,
+                                  sizeof(message));
+            }
+            calls++;
+        }
+        printf("%-22s %8.1f us/message\n", names[mode],
+               (get_time_seconds() - start) * 1e6 / (double) calls);
+    }
+    printf("(%u layers for the single word, %u per 16-symbol block)\n", word_params.num_layers,
+           block_params.num_layers);
+
+    fast_cleanup(word_ctx);
+    fast_cleanup(block_ctx);
+}
+
 int
 main()
 {
@@ -235,7 +434,10 @@ main()
 
     benchmark_different_parameters();
     benchmark_data_sizes();
+    benchmark_modular_arithmetic();
     benchmark_operations_per_second();
+    benchmark_batch_throughput();
+    benchmark_long_messages();
 
     printf("\n===================================\n");
     printf("Benchmark completed successfully!\n");
@@ -1,38 +1,752 @@
 #include "fast_internal.h"
 #include <string.h>
 
-void
-fast_cenc(const fast_params_t *params, const sbox_pool_t *pool, const uint32_t *seq,
-          const uint8_t *input, uint8_t *output, size_t length)
+// Word engine
+//
+// Instead of shifting the word after every layer, the word stays in place and its logical start
+// rotates: before layer j of a round, logical symbol i lives at data[(j + i) mod ell]. A layer
+// consumes the symbol in slot j and its output becomes the new last symbol, which is slot j again.
+// After ell layers the rotation is back to zero, and since num_layers is a multiple of ell
+// (enforced by fast_init), the word ends up in its natural order without a single byte having been
+// moved.
+//
+// Batches run groups of words in lockstep: each layer is applied to every word of the group before
+// moving on, so the dependent lookup chains of independent words overlap in the pipeline. Fully
+// unrolled shape kernels run out of registers beyond a few words, the loop kernels keep gaining
+// up to 16.
+
+#define FAST_BATCH_LANES 16U
+#define FAST_SHAPE_LANES 4U
+
+static inline uint32_t
+wrap(uint32_t pos, uint32_t ell)
+{
+    return pos >= ell ? pos - ell : pos;
+}
+
+static inline bool
+is_pow2(uint32_t radix)
+{
+    return (radix & (radix - 1)) == 0;
+}
+
+// How a kernel combines symbols, fixed at compile time for each kernel
+typedef enum {
+    ARITH_MOD, // Conditional correction, any radix
+    ARITH_MASK, // Mask, power-of-two radices (radix 256 included, where it is byte wrap-around)
+    ARITH_FUSED, // Fused tables, arithmetic folded into the lookups
+} arith_t;
+
+static inline uint8_t
+sym_add(uint32_t a, uint32_t b, uint32_t radix, arith_t arith)
+{
+    return arith == ARITH_MASK ? (uint8_t) ((a + b) & (radix - 1)) : mod_add(a, b, radix);
+}
+
+static inline uint8_t
+sym_sub(uint32_t a, uint32_t b, uint32_t radix, arith_t arith)
 {
-    if (!params || !pool || !input || !output || length != params->word_length) {
+    return arith == ARITH_MASK ? (uint8_t) ((a - b) & (radix - 1)) : mod_sub(a, b, radix);
+}
+
+int
+fast_compile_program(layer_program_t *prog, const sbox_pool_t *pool, const void *seq,
+                     uint32_t num_layers)
+{
+    if (!prog || !pool || !pool->sboxes || !seq || pool->count > FAST_MAX_SBOX_COUNT) {
+        return -1;
+    }
+
+    const bool      compact = seq_entry_size(pool->count) == sizeof(uint8_t);
+    const uint8_t  *seq8    = compact ? seq : NULL;
+    const uint16_t *seq16   = compact ? NULL : seq;
+    for (uint32_t i = 0; i < num_layers; i++) {
+        if ((compact ? seq8[i] : seq16[i]) >= pool->count) {
+            return -1;
+        }
+    }
+
+    // Only the directions the pool has built are set. Plain, padded and wide tables are all the
+    // slabs', under different kernel assumptions.
+    const bool   forward     = pool->perm_slab != NULL;
+    const bool   inverse     = pool->inv_slab != NULL;
+    const bool   wide        = pool->radix > FAST_MAX_RADIX;
+    const size_t fused_table = (size_t) pool->radix << FAST_FUSED_SHIFT;
+
+    memset(prog->enc, 0, sizeof(prog->enc));
+    memset(prog->dec, 0, sizeof(prog->dec));
+    for (size_t f = 0; f < FAST_TABLES_COUNT; f++) {
+        prog->enc_stride[f] = pool->sbox_stride;
+        prog->dec_stride[f] = pool->sbox_stride;
+    }
+    prog->enc_stride[FAST_TABLES_FUSED] = 2 * fused_table;
+    prog->dec_stride[FAST_TABLES_FUSED] = fused_table;
+
+    if (forward) {
+        prog->enc[FAST_TABLES_PLAIN]  = wide ? NULL : pool->perm_slab;
+        prog->enc[FAST_TABLES_FUSED]  = pool->fused_enc;
+        prog->enc[FAST_TABLES_PADDED] = pool->padded ? pool->perm_slab : NULL;
+        prog->enc[FAST_TABLES_WIDE]   = wide ? pool->perm_slab : NULL;
+    }
+    if (inverse) {
+        prog->dec[FAST_TABLES_PLAIN]  = wide ? NULL : pool->inv_slab;
+        prog->dec[FAST_TABLES_FUSED]  = pool->fused_dec;
+        prog->dec[FAST_TABLES_PADDED] = pool->padded ? pool->inv_slab : NULL;
+        prog->dec[FAST_TABLES_WIDE]   = wide ? pool->inv_slab : NULL;
+    }
+    prog->seq8       = seq8;
+    prog->seq16      = seq16;
+    prog->num_layers = num_layers;
+    prog->forward    = forward;
+    prog->inverse    = inverse;
+
+    return 0;
+}
+
+static inline uint32_t
+fused_at(uint32_t x, uint32_t y)
+{
+    return (x << FAST_FUSED_SHIFT) | y;
+}
+
+static inline fast_tables_t
+tables_for(arith_t arith)
+{
+    return arith == ARITH_FUSED ? FAST_TABLES_FUSED : FAST_TABLES_PLAIN;
+}
+
+// One layer on a rotating word, as slot j of a round
+static inline void
+es_step(uint8_t *data, const uint8_t *table, uint32_t j, uint32_t ell, uint32_t w, uint32_t wp,
+        uint32_t radix, arith_t arith)
+{
+    if (arith == ARITH_FUSED) {
+        const uint8_t *sub_perm = table + (radix << FAST_FUSED_SHIFT);
+
+        uint32_t row = table[fused_at(data[j], data[wrap(j + ell - wp, ell)])];
+        data[j]      = sub_perm[row | ((w > 0) ? data[wrap(j + w, ell)] : 0)];
+        return;
+    }
+
+    uint8_t s = table[sym_add(data[j], data[wrap(j + ell - wp, ell)], radix, arith)];
+    data[j]   = (w > 0) ? table[sym_sub(s, data[wrap(j + w, ell)], radix, arith)] : table[s];
+}
+
+static inline void
+ds_step(uint8_t *data, const uint8_t *table, uint32_t j, uint32_t ell, uint32_t w, uint32_t wp,
+        uint32_t radix, arith_t arith)
+{
+    if (arith == ARITH_FUSED) {
+        uint8_t t = table[fused_at(data[j], 0)];
+        t         = table[fused_at(t, (w > 0) ? data[wrap(j + w, ell)] : 0)];
+        data[j]   = mod_sub(t, data[wrap(j + ell - wp, ell)], radix);
         return;
     }
 
+    uint8_t t = table[data[j]];
+    t         = (w > 0) ? table[sym_add(t, data[wrap(j + w, ell)], radix, arith)] : table[t];
+    data[j]   = sym_sub(t, data[wrap(j + ell - wp, ell)], radix, arith);
+}
+
+#if defined(__clang__)
+#    define FAST_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__)
+#    define FAST_UNROLL _Pragma("GCC unroll 64")
+#else
+#    define FAST_UNROLL
+#endif
+
+// All rounds over lanes words stored back to back, each layer applied to every word in turn
+static inline void
+es_rounds(const fast_params_t *params, const layer_program_t *prog, uint8_t *data, uint32_t lanes,
+          arith_t arith)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t radix  = params->radix;
+    const uint32_t n      = prog->num_layers;
+    const uint8_t *tables = prog->enc[tables_for(arith)];
+    const size_t   stride = prog->enc_stride[tables_for(arith)];
+
+    for (uint32_t base = 0; base < n; base += ell) {
+        for (uint32_t j = 0; j < ell; j++) {
+            const uint8_t *table = layer_table(prog, tables, stride, base + j);
+            FAST_UNROLL
+            for (uint32_t k = 0; k < lanes; k++) {
+                es_step(data + (size_t) k * ell, table, j, ell, w, wp, radix, arith);
+            }
+        }
+    }
+}
+
+static inline void
+ds_rounds(const fast_params_t *params, const layer_program_t *prog, uint8_t *data, uint32_t lanes,
+          arith_t arith)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t radix  = params->radix;
+    const uint32_t n      = prog->num_layers;
+    const uint8_t *tables = prog->dec[tables_for(arith)];
+    const size_t   stride = prog->dec_stride[tables_for(arith)];
+
+    for (uint32_t base = n; base > 0; base -= ell) {
+        for (uint32_t j = ell; j-- > 0;) {
+            const uint8_t *table = layer_table(prog, tables, stride, base - ell + j);
+            FAST_UNROLL
+            for (uint32_t k = 0; k < lanes; k++) {
+                ds_step(data + (size_t) k * ell, table, j, ell, w, wp, radix, arith);
+            }
+        }
+    }
+}
+
+// Full groups of FAST_BATCH_LANES words, then the leftover words one by one
+static inline void
+es_batch(const fast_params_t *params, const layer_program_t *prog, uint8_t *data, size_t count,
+         arith_t arith)
+{
+    const size_t ell = params->word_length;
+    size_t       i   = 0;
+
+    for (; i + FAST_BATCH_LANES <= count; i += FAST_BATCH_LANES) {
+        es_rounds(params, prog, data + i * ell, FAST_BATCH_LANES, arith);
+    }
+    for (; i < count; i++) {
+        es_rounds(params, prog, data + i * ell, 1, arith);
+    }
+}
+
+static inline void
+ds_batch(const fast_params_t *params, const layer_program_t *prog, uint8_t *data, size_t count,
+         arith_t arith)
+{
+    const size_t ell = params->word_length;
+    size_t       i   = 0;
+
+    for (; i + FAST_BATCH_LANES <= count; i += FAST_BATCH_LANES) {
+        ds_rounds(params, prog, data + i * ell, FAST_BATCH_LANES, arith);
+    }
+    for (; i < count; i++) {
+        ds_rounds(params, prog, data + i * ell, 1, arith);
+    }
+}
+
+#define FAST_DEFINE_KERNEL_FNS(NAME, ARITH)                                                    \
+    static void es_rounds_##NAME(const fast_params_t *params, const layer_program_t *prog,     \
+                                 uint8_t *data)                                                \
+    {                                                                                          \
+        es_rounds(params, prog, data, 1, ARITH);                                               \
+    }                                                                                          \
+    static void ds_rounds_##NAME(const fast_params_t *params, const layer_program_t *prog,     \
+                                 uint8_t *data)                                                \
+    {                                                                                          \
+        ds_rounds(params, prog, data, 1, ARITH);                                               \
+    }                                                                                          \
+    static void es_batch_##NAME(const fast_params_t *params, const layer_program_t *prog,      \
+                                uint8_t *data, size_t count)                                   \
+    {                                                                                          \
+        es_batch(params, prog, data, count, ARITH);                                            \
+    }                                                                                          \
+    static void ds_batch_##NAME(const fast_params_t *params, const layer_program_t *prog,      \
+                                uint8_t *data, size_t count)                                   \
+    {                                                                                          \
+        ds_batch(params, prog, data, count, ARITH);                                            \
+    }
+
+FAST_DEFINE_KERNEL_FNS(generic, ARITH_MOD)
+FAST_DEFINE_KERNEL_FNS(pow2, ARITH_MASK)
+FAST_DEFINE_KERNEL_FNS(fused, ARITH_FUSED)
+#undef FAST_DEFINE_KERNEL_FNS
+
+// Wide words: radices above FAST_MAX_RADIX, one uint16_t per symbol, same rotation as above. The
+// kernel signatures carry words as bytes, so data is cast back to the uint16_t words the caller
+// passed in; the tables of FAST_TABLES_WIDE are the perm16 / inv16 arrays.
+
+static inline void
+es_rounds16(const fast_params_t *params, const layer_program_t *prog, uint16_t *data,
+            uint32_t lanes)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t radix  = params->radix;
+    const uint32_t n      = prog->num_layers;
+    const uint8_t *tables = prog->enc[FAST_TABLES_WIDE];
+    const size_t   stride = prog->enc_stride[FAST_TABLES_WIDE];
+
+    for (uint32_t base = 0; base < n; base += ell) {
+        for (uint32_t j = 0; j < ell; j++) {
+            const uint16_t *table = (const uint16_t *) layer_table(prog, tables, stride, base + j);
+            const uint32_t  prev  = wrap(j + ell - wp, ell);
+            const uint32_t  next  = wrap(j + w, ell);
+            for (uint32_t k = 0; k < lanes; k++) {
+                uint16_t *word = data + (size_t) k * ell;
+                uint16_t  s    = table[mod_add16(word[j], word[prev], radix)];
+                word[j]        = (w > 0) ? table[mod_sub16(s, word[next], radix)] : table[s];
+            }
+        }
+    }
+}
+
+static inline void
+ds_rounds16(const fast_params_t *params, const layer_program_t *prog, uint16_t *data,
+            uint32_t lanes)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t radix  = params->radix;
+    const uint32_t n      = prog->num_layers;
+    const uint8_t *tables = prog->dec[FAST_TABLES_WIDE];
+    const size_t   stride = prog->dec_stride[FAST_TABLES_WIDE];
+
+    for (uint32_t base = n; base > 0; base -= ell) {
+        for (uint32_t j = ell; j-- > 0;) {
+            const uint16_t *table =
+                (const uint16_t *) layer_table(prog, tables, stride, base - ell + j);
+            const uint32_t prev = wrap(j + ell - wp, ell);
+            const uint32_t next = wrap(j + w, ell);
+            for (uint32_t k = 0; k < lanes; k++) {
+                uint16_t *word = data + (size_t) k * ell;
+                uint16_t  t    = table[word[j]];
+                t              = (w > 0) ? table[mod_add16(t, word[next], radix)] : table[t];
+                word[j]        = mod_sub16(t, word[prev], radix);
+            }
+        }
+    }
+}
+
+static void
+es_rounds_wide(const fast_params_t *params, const layer_program_t *prog, uint8_t *data)
+{
+    es_rounds16(params, prog, (uint16_t *) (void *) data, 1);
+}
+
+static void
+ds_rounds_wide(const fast_params_t *params, const layer_program_t *prog, uint8_t *data)
+{
+    ds_rounds16(params, prog, (uint16_t *) (void *) data, 1);
+}
+
+static void
+es_batch_wide(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+              size_t count)
+{
+    uint16_t    *words = (uint16_t *) (void *) data;
+    const size_t ell   = params->word_length;
+    size_t       i     = 0;
+
+    for (; i + FAST_BATCH_LANES <= count; i += FAST_BATCH_LANES) {
+        es_rounds16(params, prog, words + i * ell, FAST_BATCH_LANES);
+    }
+    for (; i < count; i++) {
+        es_rounds16(params, prog, words + i * ell, 1);
+    }
+}
+
+static void
+ds_batch_wide(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+              size_t count)
+{
+    uint16_t    *words = (uint16_t *) (void *) data;
+    const size_t ell   = params->word_length;
+    size_t       i     = 0;
+
+    for (; i + FAST_BATCH_LANES <= count; i += FAST_BATCH_LANES) {
+        ds_rounds16(params, prog, words + i * ell, FAST_BATCH_LANES);
+    }
+    for (; i < count; i++) {
+        ds_rounds16(params, prog, words + i * ell, 1);
+    }
+}
+
+static void
+es_rounds_jit(const fast_params_t *params, const layer_program_t *prog, uint8_t *data)
+{
+    if (prog->jit_enc) {
+        prog->jit_enc(data);
+    } else {
+        es_rounds(params, prog, data, 1, ARITH_MOD);
+    }
+}
+
+static void
+ds_rounds_jit(const fast_params_t *params, const layer_program_t *prog, uint8_t *data)
+{
+    if (prog->jit_dec) {
+        prog->jit_dec(data);
+    } else {
+        ds_rounds(params, prog, data, 1, ARITH_MOD);
+    }
+}
+
+// Shape-specialized kernels
+//
+// Each FAST_SHAPE(radix, word_length, w, w') entry below instantiates an encrypt and a decrypt
+// kernel where all four are compile-time constants: rounds are fully unrolled, every rotated
+// index is a constant, the reduction is strength-reduced for the radix, and the words live in a
+// fixed-size local array the compiler can keep in registers. Builds can replace the list with
+// -DFAST_SHAPES='FAST_SHAPE(...) ...' (see FAST_SHAPES in the Makefile); an empty list disables
+// them.
+
+#ifndef FAST_SHAPES
+#    define FAST_SHAPES                                                                        \
+        FAST_SHAPE(10, 16, 4, 3)                                                              \
+        FAST_SHAPE(10, 19, 5, 4)                                                              \
+        FAST_SHAPE(10, 9, 3, 2)                                                               \
+        FAST_SHAPE(36, 12, 4, 3)
+#endif
+
+static inline void
+es_rounds_shape(const layer_program_t *prog, uint8_t *data, uint32_t radix, uint32_t ell,
+                uint32_t w, uint32_t wp, uint32_t lanes, uint8_t *words)
+{
+    const uint8_t *tables = prog->enc[FAST_TABLES_PLAIN];
+    const size_t   stride = prog->enc_stride[FAST_TABLES_PLAIN];
+    const arith_t  arith  = is_pow2(radix) ? ARITH_MASK : ARITH_MOD;
+
+    memcpy(words, data, (size_t) lanes * ell);
+    for (uint32_t base = 0; base < prog->num_layers; base += ell) {
+        FAST_UNROLL
+        for (uint32_t j = 0; j < ell; j++) {
+            const uint8_t *table = layer_table(prog, tables, stride, base + j);
+            FAST_UNROLL
+            for (uint32_t k = 0; k < lanes; k++) {
+                es_step(words + k * ell, table, j, ell, w, wp, radix, arith);
+            }
+        }
+    }
+    memcpy(data, words, (size_t) lanes * ell);
+}
+
+static inline void
+ds_rounds_shape(const layer_program_t *prog, uint8_t *data, uint32_t radix, uint32_t ell,
+                uint32_t w, uint32_t wp, uint32_t lanes, uint8_t *words)
+{
+    const uint8_t *tables = prog->dec[FAST_TABLES_PLAIN];
+    const size_t   stride = prog->dec_stride[FAST_TABLES_PLAIN];
+    const arith_t  arith  = is_pow2(radix) ? ARITH_MASK : ARITH_MOD;
+
+    memcpy(words, data, (size_t) lanes * ell);
+    for (uint32_t base = prog->num_layers; base > 0; base -= ell) {
+        FAST_UNROLL
+        for (uint32_t j = ell; j-- > 0;) {
+            const uint8_t *table = layer_table(prog, tables, stride, base - ell + j);
+            FAST_UNROLL
+            for (uint32_t k = 0; k < lanes; k++) {
+                ds_step(words + k * ell, table, j, ell, w, wp, radix, arith);
+            }
+        }
+    }
+    memcpy(data, words, (size_t) lanes * ell);
+}
+
+#define FAST_SHAPE(A, L, W, WP)                                                                \
+    static bool supports_shape_##A##_##L##_##W##_##WP(const fast_params_t *params,             \
+                                                      const sbox_pool_t   *pool)               \
+    {                                                                                          \
+        (void) pool;                                                                           \
+        return params->radix == (A) && params->word_length == (L) &&                           \
+               params->branch_dist1 == (W) && params->branch_dist2 == (WP);                    \
+    }                                                                                          \
+    static void es_shape_##A##_##L##_##W##_##WP(const fast_params_t *params,                   \
+                                                const layer_program_t *prog, uint8_t *data)    \
+    {                                                                                          \
+        uint8_t word[L];                                                                       \
+        (void) params;                                                                         \
+        es_rounds_shape(prog, data, A, L, W, WP, 1, word);                                     \
+    }                                                                                          \
+    static void ds_shape_##A##_##L##_##W##_##WP(const fast_params_t *params,                   \
+                                                const layer_program_t *prog, uint8_t *data)    \
+    {                                                                                          \
+        uint8_t word[L];                                                                       \
+        (void) params;                                                                         \
+        ds_rounds_shape(prog, data, A, L, W, WP, 1, word);                                     \
+    }                                                                                          \
+    static void es_shape_batch_##A##_##L##_##W##_##WP(                                         \
+        const fast_params_t *params, const layer_program_t *prog, uint8_t *data, size_t count) \
+    {                                                                                          \
+        uint8_t words[FAST_SHAPE_LANES * (L)];                                                 \
+        size_t  i = 0;                                                                         \
+        (void) params;                                                                         \
+        for (; i + FAST_SHAPE_LANES <= count; i += FAST_SHAPE_LANES) {                         \
+            es_rounds_shape(prog, data + i * (L), A, L, W, WP, FAST_SHAPE_LANES, words);       \
+        }                                                                                      \
+        for (; i < count; i++) {                                                               \
+            es_rounds_shape(prog, data + i * (L), A, L, W, WP, 1, words);                      \
+        }                                                                                      \
+    }                                                                                          \
+    static void ds_shape_batch_##A##_##L##_##W##_##WP(                                         \
+        const fast_params_t *params, const layer_program_t *prog, uint8_t *data, size_t count) \
+    {                                                                                          \
+        uint8_t words[FAST_SHAPE_LANES * (L)];                                                 \
+        size_t  i = 0;                                                                         \
+        (void) params;                                                                         \
+        for (; i + FAST_SHAPE_LANES <= count; i += FAST_SHAPE_LANES) {                         \
+            ds_rounds_shape(prog, data + i * (L), A, L, W, WP, FAST_SHAPE_LANES, words);       \
+        }                                                                                      \
+        for (; i < count; i++) {                                                               \
+            ds_rounds_shape(prog, data + i * (L), A, L, W, WP, 1, words);                      \
+        }                                                                                      \
+    }                                                                                          \
+    static const fast_kernel_t k_encrypt_shape_##A##_##L##_##W##_##WP = {                      \
+        "shape-" #A "x" #L, FAST_TABLES_PLAIN, FAST_CPU_TIER_SCALAR,                           \
+        supports_shape_##A##_##L##_##W##_##WP, es_shape_##A##_##L##_##W##_##WP,                \
+        es_shape_batch_##A##_##L##_##W##_##WP                                                  \
+    };                                                                                         \
+    static const fast_kernel_t k_decrypt_shape_##A##_##L##_##W##_##WP = {                      \
+        "shape-" #A "x" #L, FAST_TABLES_PLAIN, FAST_CPU_TIER_SCALAR,                           \
+        supports_shape_##A##_##L##_##W##_##WP, ds_shape_##A##_##L##_##W##_##WP,                \
+        ds_shape_batch_##A##_##L##_##W##_##WP                                                  \
+    };
+FAST_SHAPES
+#undef FAST_SHAPE
+
+// Kernel registry
+
+static bool
+supports_narrow(const fast_params_t *params, const sbox_pool_t *pool)
+{
+    (void) pool;
+    return params->radix <= FAST_MAX_RADIX;
+}
+
+static bool
+supports_wide(const fast_params_t *params, const sbox_pool_t *pool)
+{
+    (void) pool;
+    return params->radix > FAST_MAX_RADIX;
+}
+
+static bool
+supports_pow2(const fast_params_t *params, const sbox_pool_t *pool)
+{
+    (void) pool;
+    return params->radix <= FAST_MAX_RADIX && is_pow2(params->radix);
+}
+
+static bool
+supports_fused_enc(const fast_params_t *params, const sbox_pool_t *pool)
+{
+    (void) params;
+    return pool->fused_enc != NULL;
+}
+
+// Inverse tables may be built after kernel selection, so this goes by the radix alone
+static bool
+supports_fused_dec(const fast_params_t *params, const sbox_pool_t *pool)
+{
+    (void) pool;
+    return params->radix <= FAST_FUSED_MAX_RADIX;
+}
+
+static const fast_kernel_t k_encrypt_generic = { "generic", FAST_TABLES_PLAIN,
+                                                 FAST_CPU_TIER_SCALAR, supports_narrow,
+                                                 es_rounds_generic, es_batch_generic };
+static const fast_kernel_t k_decrypt_generic = { "generic", FAST_TABLES_PLAIN,
+                                                 FAST_CPU_TIER_SCALAR, supports_narrow,
+                                                 ds_rounds_generic, ds_batch_generic };
+static const fast_kernel_t k_encrypt_pow2    = { "pow2", FAST_TABLES_PLAIN,
+                                                 FAST_CPU_TIER_SCALAR, supports_pow2,
+                                                 es_rounds_pow2, es_batch_pow2 };
+static const fast_kernel_t k_decrypt_pow2    = { "pow2", FAST_TABLES_PLAIN,
+                                                 FAST_CPU_TIER_SCALAR, supports_pow2,
+                                                 ds_rounds_pow2, ds_batch_pow2 };
+static const fast_kernel_t k_encrypt_fused   = { "fused", FAST_TABLES_FUSED,
+                                                 FAST_CPU_TIER_SCALAR, supports_fused_enc,
+                                                 es_rounds_fused, es_batch_fused };
+static const fast_kernel_t k_decrypt_fused   = { "fused", FAST_TABLES_FUSED,
+                                                 FAST_CPU_TIER_SCALAR, supports_fused_dec,
+                                                 ds_rounds_fused, ds_batch_fused };
+static const fast_kernel_t k_encrypt_wide    = { "wide", FAST_TABLES_WIDE, FAST_CPU_TIER_SCALAR,
+                                                 supports_wide, es_rounds_wide, es_batch_wide };
+static const fast_kernel_t k_decrypt_wide    = { "wide", FAST_TABLES_WIDE, FAST_CPU_TIER_SCALAR,
+                                                 supports_wide, ds_rounds_wide, ds_batch_wide };
+
+static bool
+supports_jit(const fast_params_t *params, const sbox_pool_t *pool)
+{
+    (void) pool;
+    return fast_jit_available(params);
+}
+
+const fast_kernel_t fast_jit_encrypt_kernel = { "jit", FAST_TABLES_PLAIN, FAST_CPU_TIER_SCALAR,
+                                                supports_jit, es_rounds_jit, NULL };
+const fast_kernel_t fast_jit_decrypt_kernel = { "jit", FAST_TABLES_PLAIN, FAST_CPU_TIER_SCALAR,
+                                                supports_jit, ds_rounds_jit, NULL };
+
+// Fused forward tables only exist while they are L1-resident, and then beat masking. Inverse
+// tables exist for every small radix, but masking is cheaper than their second lookup.
+// Vector kernels are batch-only and lead the lists, word selection skips them. Shape kernels come
+// next: each one only matches its exact parameter set. Radices above FAST_MAX_RADIX only have the
+// wide kernels, which serve nothing else
+#ifdef FAST_X86_KERNELS
+#    define FAST_X86_ENCRYPT_KERNELS                                                           \
+        &fast_x86_encrypt_vbmi_256, &fast_x86_encrypt_avx2_256, &fast_x86_encrypt_vbmi,        \
+        &fast_x86_encrypt_avx2, &fast_x86_encrypt_ssse3,
+#    define FAST_X86_DECRYPT_KERNELS                                                           \
+        &fast_x86_decrypt_vbmi_256, &fast_x86_decrypt_avx2_256, &fast_x86_decrypt_vbmi,        \
+        &fast_x86_decrypt_avx2, &fast_x86_decrypt_ssse3,
+#else
+#    define FAST_X86_ENCRYPT_KERNELS
+#    define FAST_X86_DECRYPT_KERNELS
+#endif
+
+#define FAST_SHAPE(A, L, W, WP) &k_encrypt_shape_##A##_##L##_##W##_##WP,
+const fast_kernel_t *const fast_encrypt_kernels[] = {
+    FAST_X86_ENCRYPT_KERNELS FAST_SHAPES &k_encrypt_fused, &k_encrypt_pow2, &k_encrypt_generic,
+    &k_encrypt_wide, NULL
+};
+#undef FAST_SHAPE
+#define FAST_SHAPE(A, L, W, WP) &k_decrypt_shape_##A##_##L##_##W##_##WP,
+const fast_kernel_t *const fast_decrypt_kernels[] = {
+    FAST_X86_DECRYPT_KERNELS FAST_SHAPES &k_decrypt_pow2, &k_decrypt_fused, &k_decrypt_generic,
+    &k_decrypt_wide, NULL
+};
+#undef FAST_SHAPE
+
+static const fast_kernel_t *
+select_kernel(const fast_kernel_t *const *kernels, const fast_params_t *params,
+              const sbox_pool_t *pool, fast_cpu_tier_t tier, bool batch)
+{
+    if (!kernels || !params || !pool) {
+        return NULL;
+    }
+
+    for (size_t i = 0; kernels[i]; i++) {
+        if ((batch ? kernels[i]->batch != NULL : kernels[i]->run != NULL) &&
+            kernels[i]->tier <= tier && kernels[i]->supports(params, pool)) {
+            return kernels[i];
+        }
+    }
+    return NULL;
+}
+
+const fast_kernel_t *
+fast_select_kernel(const fast_kernel_t *const *kernels, const fast_params_t *params,
+                   const sbox_pool_t *pool, fast_cpu_tier_t tier)
+{
+    return select_kernel(kernels, params, pool, tier, false);
+}
+
+const fast_kernel_t *
+fast_select_batch_kernel(const fast_kernel_t *const *kernels, const fast_params_t *params,
+                         const sbox_pool_t *pool, fast_cpu_tier_t tier)
+{
+    return select_kernel(kernels, params, pool, tier, true);
+}
+
+static bool
+program_matches(const fast_params_t *params, const layer_program_t *prog, size_t length)
+{
+    return params && prog && length == params->word_length &&
+           prog->num_layers == params->num_layers && prog->num_layers % params->word_length == 0;
+}
+
+int
+fast_cenc(const fast_kernel_t *kernel, const fast_params_t *params, const layer_program_t *prog,
+          const uint8_t *input, uint8_t *output, size_t length)
+{
+    if (!kernel || !kernel->run || !program_matches(params, prog, length) ||
+        !prog->forward || !prog->enc[kernel->tables] || !input || !output) {
+        return -1;
+    }
+
     if (input != output) {
         memcpy(output, input, length);
     }
 
-    for (uint32_t i = 0; i < params->num_layers; i++) {
-        uint32_t sbox_index = seq ? seq[i] : (i % pool->count);
-        fast_es_layer(params, pool, output, length, sbox_index);
-    }
+    kernel->run(params, prog, output);
+    return 0;
 }
 
-void
-fast_cdec(const fast_params_t *params, const sbox_pool_t *pool, const uint32_t *seq,
+int
+fast_cdec(const fast_kernel_t *kernel, const fast_params_t *params, const layer_program_t *prog,
           const uint8_t *input, uint8_t *output, size_t length)
 {
-    if (!params || !pool || !input || !output || length != params->word_length) {
-        return;
+    if (!kernel || !kernel->run || !program_matches(params, prog, length) ||
+        !prog->inverse || !prog->dec[kernel->tables] || !input || !output) {
+        return -1;
     }
 
     if (input != output) {
         memcpy(output, input, length);
     }
 
-    for (int i = (int) params->num_layers - 1; i >= 0; i--) {
-        uint32_t sbox_index = seq ? seq[i] : ((uint32_t) i % pool->count);
-        fast_ds_layer(params, pool, output, length, sbox_index);
+    kernel->run(params, prog, output);
+    return 0;
+}
+
+int
+fast_cenc_batch(const fast_kernel_t *kernel, const fast_params_t *params,
+                const layer_program_t *prog, const uint8_t *input, uint8_t *output, size_t length,
+                size_t count)
+{
+    if (!kernel || !kernel->batch || !program_matches(params, prog, length) ||
+        !prog->forward || !prog->enc[kernel->tables] || !input || !output) {
+        return -1;
+    }
+
+    if (input != output) {
+        memcpy(output, input, length * count);
+    }
+
+    kernel->batch(params, prog, output, count);
+    return 0;
+}
+
+int
+fast_cdec_batch(const fast_kernel_t *kernel, const fast_params_t *params,
+                const layer_program_t *prog, const uint8_t *input, uint8_t *output, size_t length,
+                size_t count)
+{
+    if (!kernel || !kernel->batch || !program_matches(params, prog, length) ||
+        !prog->inverse || !prog->dec[kernel->tables] || !input || !output) {
+        return -1;
+    }
+
+    if (input != output) {
+        memcpy(output, input, length * count);
+    }
+
+    kernel->batch(params, prog, output, count);
+    return 0;
+}
+
+// Same as fast_cenc / fast_cdec, for the wide kernels
+int
+fast_cenc16(const fast_kernel_t *kernel, const fast_params_t *params, const layer_program_t *prog,
+            const uint16_t *input, uint16_t *output, size_t length)
+{
+    if (!kernel || !kernel->run || !program_matches(params, prog, length) ||
+        !prog->forward || !prog->enc[kernel->tables] || !input || !output) {
+        return -1;
+    }
+
+    if (input != output) {
+        memcpy(output, input, length * sizeof(uint16_t));
+    }
+
+    kernel->run(params, prog, (uint8_t *) (void *) output);
+    return 0;
+}
+
+int
+fast_cdec16(const fast_kernel_t *kernel, const fast_params_t *params, const layer_program_t *prog,
+            const uint16_t *input, uint16_t *output, size_t length)
+{
+    if (!kernel || !kernel->run || !program_matches(params, prog, length) ||
+        !prog->inverse || !prog->dec[kernel->tables] || !input || !output) {
+        return -1;
+    }
+
+    if (input != output) {
+        memcpy(output, input, length * sizeof(uint16_t));
     }
+
+    kernel->run(params, prog, (uint8_t *) (void *) output);
+    return 0;
 }
@@ -0,0 +1,633 @@
+#include "fast_internal.h"
+#include <string.h>
+
+#ifdef FAST_X86_KERNELS
+
+#    include <immintrin.h>
+
+// Vector batch kernels
+//
+// Words are transposed into structure-of-arrays form: vector i holds symbol i of every word of the
+// group, one word per byte lane. Layers then run exactly like the scalar engine, with the same
+// rotating slots, on whole vectors, and an S-box lookup is a single byte shuffle or permute of the
+// layer's padded table:
+//   - radix <= 16: the table fits in a 16-byte pshufb control, 16 (SSSE3) or 32 (AVX2) words
+//   - radix <= 128: the table fits in one or two zmm registers, vpermb or vpermi2b over 64 words
+//     (AVX-512 VBMI)
+//   - radix 256: the S-box arrays themselves are the tables, either as four zmm registers (AVX-512
+//     VBMI, 64 words) or as sixteen 16-byte pshufb rows (AVX2, 32 words)
+//
+// Modular arithmetic uses an unsigned byte minimum: for a sum s of two symbols, s - radix wraps
+// around above s when s < radix and is the reduced value otherwise, so min(s, s - radix) is the
+// sum mod radix. A difference is reduced the same way with min(d, d + radix). Both hold as long
+// as the radix is at most 128; radix 256 is plain byte wrap-around.
+//
+// Lanes past the last word of a partial group hold zeros, a valid symbol, and are discarded.
+
+#    define FAST_TARGET_SSSE3 __attribute__((target("ssse3")))
+#    define FAST_TARGET_AVX2  __attribute__((target("avx2")))
+#    define FAST_TARGET_VBMI  __attribute__((target("avx512f,avx512bw,avx512vbmi")))
+
+static inline uint32_t
+wrap(uint32_t pos, uint32_t ell)
+{
+    return pos >= ell ? pos - ell : pos;
+}
+
+static void
+to_lanes(uint8_t *lanes, const uint8_t *data, size_t words, uint32_t ell, uint32_t width)
+{
+    if (words < width) {
+        memset(lanes, 0, (size_t) ell * width);
+    }
+    for (size_t k = 0; k < words; k++) {
+        for (uint32_t i = 0; i < ell; i++) {
+            lanes[(size_t) i * width + k] = data[k * ell + i];
+        }
+    }
+}
+
+static void
+from_lanes(uint8_t *data, const uint8_t *lanes, size_t words, uint32_t ell, uint32_t width)
+{
+    for (size_t k = 0; k < words; k++) {
+        for (uint32_t i = 0; i < ell; i++) {
+            data[k * ell + i] = lanes[(size_t) i * width + k];
+        }
+    }
+}
+
+static bool
+supports_shuffle(const fast_params_t *params, const sbox_pool_t *pool)
+{
+    return params->radix <= 16 && params->word_length <= FAST_VECTOR_MAX_LENGTH &&
+           pool->padded;
+}
+
+// SSSE3, 16 words per group
+
+FAST_TARGET_SSSE3 static inline __m128i
+add_ssse3(__m128i a, __m128i b, __m128i radix)
+{
+    __m128i s = _mm_add_epi8(a, b);
+    return _mm_min_epu8(s, _mm_sub_epi8(s, radix));
+}
+
+FAST_TARGET_SSSE3 static inline __m128i
+sub_ssse3(__m128i a, __m128i b, __m128i radix)
+{
+    __m128i d = _mm_sub_epi8(a, b);
+    return _mm_min_epu8(d, _mm_add_epi8(d, radix));
+}
+
+FAST_TARGET_SSSE3 static void
+es_group_ssse3(const fast_params_t *params, const layer_program_t *prog, __m128i *v)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t n      = prog->num_layers;
+    const __m128i  radix  = _mm_set1_epi8((char) params->radix);
+    const uint8_t *tables = prog->enc[FAST_TABLES_PADDED];
+    const size_t   stride = prog->enc_stride[FAST_TABLES_PADDED];
+
+    for (uint32_t base = 0; base < n; base += ell) {
+        for (uint32_t j = 0; j < ell; j++) {
+            const uint8_t *table = layer_table(prog, tables, stride, base + j);
+            const __m128i  perm  = _mm_loadu_si128((const __m128i *) table);
+            const __m128i  xa    = v[wrap(j + ell - wp, ell)];
+            const __m128i  xw    = v[wrap(j + w, ell)];
+
+            __m128i s = _mm_shuffle_epi8(perm, add_ssse3(v[j], xa, radix));
+            v[j]      = _mm_shuffle_epi8(perm, (w > 0) ? sub_ssse3(s, xw, radix) : s);
+        }
+    }
+}
+
+FAST_TARGET_SSSE3 static void
+ds_group_ssse3(const fast_params_t *params, const layer_program_t *prog, __m128i *v)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t n      = prog->num_layers;
+    const __m128i  radix  = _mm_set1_epi8((char) params->radix);
+    const uint8_t *tables = prog->dec[FAST_TABLES_PADDED];
+    const size_t   stride = prog->dec_stride[FAST_TABLES_PADDED];
+
+    for (uint32_t base = n; base > 0; base -= ell) {
+        for (uint32_t j = ell; j-- > 0;) {
+            const uint8_t *table = layer_table(prog, tables, stride, base - ell + j);
+            const __m128i  inv   = _mm_loadu_si128((const __m128i *) table);
+            const __m128i  xa    = v[wrap(j + ell - wp, ell)];
+            const __m128i  xw    = v[wrap(j + w, ell)];
+
+            __m128i t = _mm_shuffle_epi8(inv, v[j]);
+            t         = _mm_shuffle_epi8(inv, (w > 0) ? add_ssse3(t, xw, radix) : t);
+            v[j]      = sub_ssse3(t, xa, radix);
+        }
+    }
+}
+
+FAST_TARGET_SSSE3 static void
+es_batch_ssse3(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+               size_t count)
+{
+    const uint32_t ell = params->word_length;
+    __m128i        v[FAST_VECTOR_MAX_LENGTH];
+
+    for (size_t i = 0; i < count; i += 16) {
+        const size_t words = (count - i < 16) ? count - i : 16;
+
+        to_lanes((uint8_t *) v, data + i * ell, words, ell, 16);
+        es_group_ssse3(params, prog, v);
+        from_lanes(data + i * ell, (const uint8_t *) v, words, ell, 16);
+    }
+}
+
+FAST_TARGET_SSSE3 static void
+ds_batch_ssse3(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+               size_t count)
+{
+    const uint32_t ell = params->word_length;
+    __m128i        v[FAST_VECTOR_MAX_LENGTH];
+
+    for (size_t i = 0; i < count; i += 16) {
+        const size_t words = (count - i < 16) ? count - i : 16;
+
+        to_lanes((uint8_t *) v, data + i * ell, words, ell, 16);
+        ds_group_ssse3(params, prog, v);
+        from_lanes(data + i * ell, (const uint8_t *) v, words, ell, 16);
+    }
+}
+
+// AVX2, 32 words per group. pshufb works within 128-bit halves, so tables are broadcast to both.
+
+FAST_TARGET_AVX2 static inline __m256i
+add_avx2(__m256i a, __m256i b, __m256i radix)
+{
+    __m256i s = _mm256_add_epi8(a, b);
+    return _mm256_min_epu8(s, _mm256_sub_epi8(s, radix));
+}
+
+FAST_TARGET_AVX2 static inline __m256i
+sub_avx2(__m256i a, __m256i b, __m256i radix)
+{
+    __m256i d = _mm256_sub_epi8(a, b);
+    return _mm256_min_epu8(d, _mm256_add_epi8(d, radix));
+}
+
+FAST_TARGET_AVX2 static void
+es_group_avx2(const fast_params_t *params, const layer_program_t *prog, __m256i *v)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t n      = prog->num_layers;
+    const __m256i  radix  = _mm256_set1_epi8((char) params->radix);
+    const uint8_t *tables = prog->enc[FAST_TABLES_PADDED];
+    const size_t   stride = prog->enc_stride[FAST_TABLES_PADDED];
+
+    for (uint32_t base = 0; base < n; base += ell) {
+        for (uint32_t j = 0; j < ell; j++) {
+            const uint8_t *table = layer_table(prog, tables, stride, base + j);
+            const __m256i  perm =
+                _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) table));
+            const __m256i xa = v[wrap(j + ell - wp, ell)];
+            const __m256i xw = v[wrap(j + w, ell)];
+
+            __m256i s = _mm256_shuffle_epi8(perm, add_avx2(v[j], xa, radix));
+            v[j]      = _mm256_shuffle_epi8(perm, (w > 0) ? sub_avx2(s, xw, radix) : s);
+        }
+    }
+}
+
+FAST_TARGET_AVX2 static void
+ds_group_avx2(const fast_params_t *params, const layer_program_t *prog, __m256i *v)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t n      = prog->num_layers;
+    const __m256i  radix  = _mm256_set1_epi8((char) params->radix);
+    const uint8_t *tables = prog->dec[FAST_TABLES_PADDED];
+    const size_t   stride = prog->dec_stride[FAST_TABLES_PADDED];
+
+    for (uint32_t base = n; base > 0; base -= ell) {
+        for (uint32_t j = ell; j-- > 0;) {
+            const uint8_t *table = layer_table(prog, tables, stride, base - ell + j);
+            const __m256i  inv =
+                _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) table));
+            const __m256i xa = v[wrap(j + ell - wp, ell)];
+            const __m256i xw = v[wrap(j + w, ell)];
+
+            __m256i t = _mm256_shuffle_epi8(inv, v[j]);
+            t         = _mm256_shuffle_epi8(inv, (w > 0) ? add_avx2(t, xw, radix) : t);
+            v[j]      = sub_avx2(t, xa, radix);
+        }
+    }
+}
+
+FAST_TARGET_AVX2 static void
+es_batch_avx2(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+              size_t count)
+{
+    const uint32_t ell = params->word_length;
+    __m256i        v[FAST_VECTOR_MAX_LENGTH];
+
+    for (size_t i = 0; i < count; i += 32) {
+        const size_t words = (count - i < 32) ? count - i : 32;
+
+        to_lanes((uint8_t *) v, data + i * ell, words, ell, 32);
+        es_group_avx2(params, prog, v);
+        from_lanes(data + i * ell, (const uint8_t *) v, words, ell, 32);
+    }
+}
+
+FAST_TARGET_AVX2 static void
+ds_batch_avx2(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+              size_t count)
+{
+    const uint32_t ell = params->word_length;
+    __m256i        v[FAST_VECTOR_MAX_LENGTH];
+
+    for (size_t i = 0; i < count; i += 32) {
+        const size_t words = (count - i < 32) ? count - i : 32;
+
+        to_lanes((uint8_t *) v, data + i * ell, words, ell, 32);
+        ds_group_avx2(params, prog, v);
+        from_lanes(data + i * ell, (const uint8_t *) v, words, ell, 32);
+    }
+}
+
+// AVX-512 VBMI, 64 words per group. Tables of up to 64 bytes are one register and a vpermb index,
+// 128-byte tables are two registers and a vpermi2b index. Shorter strides are loaded under a mask,
+// so nothing is read past the table.
+
+FAST_TARGET_VBMI static inline __m512i
+add_vbmi(__m512i a, __m512i b, __m512i radix)
+{
+    __m512i s = _mm512_add_epi8(a, b);
+    return _mm512_min_epu8(s, _mm512_sub_epi8(s, radix));
+}
+
+FAST_TARGET_VBMI static inline __m512i
+sub_vbmi(__m512i a, __m512i b, __m512i radix)
+{
+    __m512i d = _mm512_sub_epi8(a, b);
+    return _mm512_min_epu8(d, _mm512_add_epi8(d, radix));
+}
+
+FAST_TARGET_VBMI static inline __m512i
+lookup_vbmi(__m512i lo, __m512i hi, __m512i idx, bool wide)
+{
+    return wide ? _mm512_permutex2var_epi8(lo, idx, hi) : _mm512_permutexvar_epi8(idx, lo);
+}
+
+FAST_TARGET_VBMI static inline void
+es_group_vbmi(const fast_params_t *params, const layer_program_t *prog, __m512i *v,
+              __mmask64 load, bool wide)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t n      = prog->num_layers;
+    const __m512i  radix  = _mm512_set1_epi8((char) params->radix);
+    const uint8_t *tables = prog->enc[FAST_TABLES_PADDED];
+    const size_t   stride = prog->enc_stride[FAST_TABLES_PADDED];
+
+    for (uint32_t base = 0; base < n; base += ell) {
+        for (uint32_t j = 0; j < ell; j++) {
+            const uint8_t *table = layer_table(prog, tables, stride, base + j);
+            const __m512i  lo    = _mm512_maskz_loadu_epi8(load, table);
+            const __m512i  hi    = wide ? _mm512_loadu_si512(table + 64) : lo;
+            const __m512i  xa    = v[wrap(j + ell - wp, ell)];
+            const __m512i  xw    = v[wrap(j + w, ell)];
+
+            __m512i s = lookup_vbmi(lo, hi, add_vbmi(v[j], xa, radix), wide);
+            v[j]      = lookup_vbmi(lo, hi, (w > 0) ? sub_vbmi(s, xw, radix) : s, wide);
+        }
+    }
+}
+
+FAST_TARGET_VBMI static inline void
+ds_group_vbmi(const fast_params_t *params, const layer_program_t *prog, __m512i *v,
+              __mmask64 load, bool wide)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t n      = prog->num_layers;
+    const __m512i  radix  = _mm512_set1_epi8((char) params->radix);
+    const uint8_t *tables = prog->dec[FAST_TABLES_PADDED];
+    const size_t   stride = prog->dec_stride[FAST_TABLES_PADDED];
+
+    for (uint32_t base = n; base > 0; base -= ell) {
+        for (uint32_t j = ell; j-- > 0;) {
+            const uint8_t *table = layer_table(prog, tables, stride, base - ell + j);
+            const __m512i  lo    = _mm512_maskz_loadu_epi8(load, table);
+            const __m512i  hi    = wide ? _mm512_loadu_si512(table + 64) : lo;
+            const __m512i  xa    = v[wrap(j + ell - wp, ell)];
+            const __m512i  xw    = v[wrap(j + w, ell)];
+
+            __m512i t = lookup_vbmi(lo, hi, v[j], wide);
+            t         = lookup_vbmi(lo, hi, (w > 0) ? add_vbmi(t, xw, radix) : t, wide);
+            v[j]      = sub_vbmi(t, xa, radix);
+        }
+    }
+}
+
+static __mmask64
+table_load_mask(uint32_t radix)
+{
+    const uint32_t stride = padded_stride(radix);
+    return stride >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << stride) - 1;
+}
+
+FAST_TARGET_VBMI static void
+es_batch_vbmi(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+              size_t count)
+{
+    const uint32_t  ell  = params->word_length;
+    const bool      wide = params->radix > 64;
+    const __mmask64 load = wide ? ~(__mmask64) 0 : table_load_mask(params->radix);
+    __m512i         v[FAST_VECTOR_MAX_LENGTH];
+
+    for (size_t i = 0; i < count; i += 64) {
+        const size_t words = (count - i < 64) ? count - i : 64;
+
+        to_lanes((uint8_t *) v, data + i * ell, words, ell, 64);
+        if (wide) {
+            es_group_vbmi(params, prog, v, load, true);
+        } else {
+            es_group_vbmi(params, prog, v, load, false);
+        }
+        from_lanes(data + i * ell, (const uint8_t *) v, words, ell, 64);
+    }
+}
+
+FAST_TARGET_VBMI static void
+ds_batch_vbmi(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+              size_t count)
+{
+    const uint32_t  ell  = params->word_length;
+    const bool      wide = params->radix > 64;
+    const __mmask64 load = wide ? ~(__mmask64) 0 : table_load_mask(params->radix);
+    __m512i         v[FAST_VECTOR_MAX_LENGTH];
+
+    for (size_t i = 0; i < count; i += 64) {
+        const size_t words = (count - i < 64) ? count - i : 64;
+
+        to_lanes((uint8_t *) v, data + i * ell, words, ell, 64);
+        if (wide) {
+            ds_group_vbmi(params, prog, v, load, true);
+        } else {
+            ds_group_vbmi(params, prog, v, load, false);
+        }
+        from_lanes(data + i * ell, (const uint8_t *) v, words, ell, 64);
+    }
+}
+
+// AVX2, radix 256, 32 words per group. Row h of the table serves the lanes whose high nibble is h:
+// x ^ (h << 4) brings exactly those lanes below 16, and a saturating add of 0x70 then pushes every
+// other lane to 0x80 or above, which pshufb turns into zero. The sixteen partial lookups are ORed.
+
+FAST_TARGET_AVX2 static inline __m256i
+lookup256_avx2(const uint8_t *table, __m256i x)
+{
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    __m256i       r    = _mm256_setzero_si256();
+
+    for (int h = 0; h < 16; h++) {
+        const __m256i row =
+            _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (table + 16 * h)));
+        const __m256i sel =
+            _mm256_adds_epu8(_mm256_xor_si256(x, _mm256_set1_epi8((char) (h << 4))), bias);
+        r = _mm256_or_si256(r, _mm256_shuffle_epi8(row, sel));
+    }
+    return r;
+}
+
+FAST_TARGET_AVX2 static void
+es_group256_avx2(const fast_params_t *params, const layer_program_t *prog, __m256i *v)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t n      = prog->num_layers;
+    const uint8_t *tables = prog->enc[FAST_TABLES_PLAIN];
+    const size_t   stride = prog->enc_stride[FAST_TABLES_PLAIN];
+
+    for (uint32_t base = 0; base < n; base += ell) {
+        for (uint32_t j = 0; j < ell; j++) {
+            const uint8_t *perm = layer_table(prog, tables, stride, base + j);
+            const __m256i  xa   = v[wrap(j + ell - wp, ell)];
+            const __m256i  xw   = v[wrap(j + w, ell)];
+
+            __m256i s = lookup256_avx2(perm, _mm256_add_epi8(v[j], xa));
+            v[j]      = lookup256_avx2(perm, (w > 0) ? _mm256_sub_epi8(s, xw) : s);
+        }
+    }
+}
+
+FAST_TARGET_AVX2 static void
+ds_group256_avx2(const fast_params_t *params, const layer_program_t *prog, __m256i *v)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t n      = prog->num_layers;
+    const uint8_t *tables = prog->dec[FAST_TABLES_PLAIN];
+    const size_t   stride = prog->dec_stride[FAST_TABLES_PLAIN];
+
+    for (uint32_t base = n; base > 0; base -= ell) {
+        for (uint32_t j = ell; j-- > 0;) {
+            const uint8_t *inv = layer_table(prog, tables, stride, base - ell + j);
+            const __m256i  xa  = v[wrap(j + ell - wp, ell)];
+            const __m256i  xw  = v[wrap(j + w, ell)];
+
+            __m256i t = lookup256_avx2(inv, v[j]);
+            t         = lookup256_avx2(inv, (w > 0) ? _mm256_add_epi8(t, xw) : t);
+            v[j]      = _mm256_sub_epi8(t, xa);
+        }
+    }
+}
+
+FAST_TARGET_AVX2 static void
+es_batch256_avx2(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+                 size_t count)
+{
+    const uint32_t ell = params->word_length;
+    __m256i        v[FAST_VECTOR_MAX_LENGTH];
+
+    for (size_t i = 0; i < count; i += 32) {
+        const size_t words = (count - i < 32) ? count - i : 32;
+
+        to_lanes((uint8_t *) v, data + i * ell, words, ell, 32);
+        es_group256_avx2(params, prog, v);
+        from_lanes(data + i * ell, (const uint8_t *) v, words, ell, 32);
+    }
+}
+
+FAST_TARGET_AVX2 static void
+ds_batch256_avx2(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+                 size_t count)
+{
+    const uint32_t ell = params->word_length;
+    __m256i        v[FAST_VECTOR_MAX_LENGTH];
+
+    for (size_t i = 0; i < count; i += 32) {
+        const size_t words = (count - i < 32) ? count - i : 32;
+
+        to_lanes((uint8_t *) v, data + i * ell, words, ell, 32);
+        ds_group256_avx2(params, prog, v);
+        from_lanes(data + i * ell, (const uint8_t *) v, words, ell, 32);
+    }
+}
+
+// AVX-512 VBMI, radix 256, 64 words per group: two vpermi2b cover the low and high halves of the
+// table, and bit 7 of the index picks between them.
+
+FAST_TARGET_VBMI static inline __m512i
+lookup256_vbmi(const __m512i *t, __m512i x)
+{
+    const __m512i lo = _mm512_permutex2var_epi8(t[0], x, t[1]);
+    const __m512i hi = _mm512_permutex2var_epi8(t[2], x, t[3]);
+    return _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), lo, hi);
+}
+
+FAST_TARGET_VBMI static inline void
+load256_vbmi(__m512i *t, const uint8_t *table)
+{
+    for (int i = 0; i < 4; i++) {
+        t[i] = _mm512_loadu_si512(table + 64 * i);
+    }
+}
+
+FAST_TARGET_VBMI static void
+es_group256_vbmi(const fast_params_t *params, const layer_program_t *prog, __m512i *v)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t n      = prog->num_layers;
+    const uint8_t *tables = prog->enc[FAST_TABLES_PLAIN];
+    const size_t   stride = prog->enc_stride[FAST_TABLES_PLAIN];
+
+    for (uint32_t base = 0; base < n; base += ell) {
+        for (uint32_t j = 0; j < ell; j++) {
+            const __m512i xa = v[wrap(j + ell - wp, ell)];
+            const __m512i xw = v[wrap(j + w, ell)];
+            __m512i       perm[4];
+
+            load256_vbmi(perm, layer_table(prog, tables, stride, base + j));
+            __m512i s = lookup256_vbmi(perm, _mm512_add_epi8(v[j], xa));
+            v[j]      = lookup256_vbmi(perm, (w > 0) ? _mm512_sub_epi8(s, xw) : s);
+        }
+    }
+}
+
+FAST_TARGET_VBMI static void
+ds_group256_vbmi(const fast_params_t *params, const layer_program_t *prog, __m512i *v)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t n      = prog->num_layers;
+    const uint8_t *tables = prog->dec[FAST_TABLES_PLAIN];
+    const size_t   stride = prog->dec_stride[FAST_TABLES_PLAIN];
+
+    for (uint32_t base = n; base > 0; base -= ell) {
+        for (uint32_t j = ell; j-- > 0;) {
+            const __m512i xa = v[wrap(j + ell - wp, ell)];
+            const __m512i xw = v[wrap(j + w, ell)];
+            __m512i       inv[4];
+
+            load256_vbmi(inv, layer_table(prog, tables, stride, base - ell + j));
+            __m512i t = lookup256_vbmi(inv, v[j]);
+            t         = lookup256_vbmi(inv, (w > 0) ? _mm512_add_epi8(t, xw) : t);
+            v[j]      = _mm512_sub_epi8(t, xa);
+        }
+    }
+}
+
+FAST_TARGET_VBMI static void
+es_batch256_vbmi(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+                 size_t count)
+{
+    const uint32_t ell = params->word_length;
+    __m512i        v[FAST_VECTOR_MAX_LENGTH];
+
+    for (size_t i = 0; i < count; i += 64) {
+        const size_t words = (count - i < 64) ? count - i : 64;
+
+        to_lanes((uint8_t *) v, data + i * ell, words, ell, 64);
+        es_group256_vbmi(params, prog, v);
+        from_lanes(data + i * ell, (const uint8_t *) v, words, ell, 64);
+    }
+}
+
+FAST_TARGET_VBMI static void
+ds_batch256_vbmi(const fast_params_t *params, const layer_program_t *prog, uint8_t *data,
+                 size_t count)
+{
+    const uint32_t ell = params->word_length;
+    __m512i        v[FAST_VECTOR_MAX_LENGTH];
+
+    for (size_t i = 0; i < count; i += 64) {
+        const size_t words = (count - i < 64) ? count - i : 64;
+
+        to_lanes((uint8_t *) v, data + i * ell, words, ell, 64);
+        ds_group256_vbmi(params, prog, v);
+        from_lanes(data + i * ell, (const uint8_t *) v, words, ell, 64);
+    }
+}
+
+static bool
+supports_permute(const fast_params_t *params, const sbox_pool_t *pool)
+{
+    return params->radix <= 128 && params->word_length <= FAST_VECTOR_MAX_LENGTH &&
+           pool->padded;
+}
+
+static bool
+supports_radix256(const fast_params_t *params, const sbox_pool_t *pool)
+{
+    (void) pool;
+    return params->radix == 256 && params->word_length <= FAST_VECTOR_MAX_LENGTH;
+}
+
+// CPU support is not checked here: each kernel is tagged with the tier it needs, and selection
+// skips kernels above the tier in effect (see cpu.c)
+const fast_kernel_t fast_x86_encrypt_ssse3 = { "ssse3-shuffle", FAST_TABLES_PADDED,
+                                               FAST_CPU_TIER_SSSE3, supports_shuffle,
+                                               NULL, es_batch_ssse3 };
+const fast_kernel_t fast_x86_decrypt_ssse3 = { "ssse3-shuffle", FAST_TABLES_PADDED,
+                                               FAST_CPU_TIER_SSSE3, supports_shuffle,
+                                               NULL, ds_batch_ssse3 };
+const fast_kernel_t fast_x86_encrypt_avx2  = { "avx2-shuffle", FAST_TABLES_PADDED,
+                                               FAST_CPU_TIER_AVX2, supports_shuffle,
+                                               NULL, es_batch_avx2 };
+const fast_kernel_t fast_x86_decrypt_avx2  = { "avx2-shuffle", FAST_TABLES_PADDED,
+                                               FAST_CPU_TIER_AVX2, supports_shuffle,
+                                               NULL, ds_batch_avx2 };
+const fast_kernel_t fast_x86_encrypt_vbmi  = { "vbmi-permute", FAST_TABLES_PADDED,
+                                               FAST_CPU_TIER_AVX512, supports_permute,
+                                               NULL, es_batch_vbmi };
+const fast_kernel_t fast_x86_decrypt_vbmi  = { "vbmi-permute", FAST_TABLES_PADDED,
+                                               FAST_CPU_TIER_AVX512, supports_permute,
+                                               NULL, ds_batch_vbmi };
+const fast_kernel_t fast_x86_encrypt_avx2_256 = { "avx2-radix256", FAST_TABLES_PLAIN,
+                                                  FAST_CPU_TIER_AVX2, supports_radix256,
+                                                  NULL, es_batch256_avx2 };
+const fast_kernel_t fast_x86_decrypt_avx2_256 = { "avx2-radix256", FAST_TABLES_PLAIN,
+                                                  FAST_CPU_TIER_AVX2, supports_radix256,
+                                                  NULL, ds_batch256_avx2 };
+const fast_kernel_t fast_x86_encrypt_vbmi_256 = { "vbmi-radix256", FAST_TABLES_PLAIN,
+                                                  FAST_CPU_TIER_AVX512, supports_radix256,
+                                                  NULL, es_batch256_vbmi };
+const fast_kernel_t fast_x86_decrypt_vbmi_256 = { "vbmi-radix256", FAST_TABLES_PLAIN,
+                                                  FAST_CPU_TIER_AVX512, supports_radix256,
+                                                  NULL, ds_batch256_vbmi };
+
+#endif // FAST_X86_KERNELS
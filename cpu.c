@@ -0,0 +1,145 @@
+#include "fast_internal.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FAST_X86_KERNELS
+#    include <cpuid.h>
+#endif
+
+// CPU tier selection
+//
+// The CPU is probed once, together with the FAST_CPU_TIER environment variable, under
+// pthread_once() so that contexts created concurrently all see the finished probe. fast_init binds
+// each context to the best kernels of the tier in effect at that time; the tier can be lowered
+// for debugging, never raised above what the CPU supports.
+
+static const char *const k_tier_names[] = { "scalar", "ssse3", "avx2", "avx512" };
+
+static pthread_once_t  tiers_once    = PTHREAD_ONCE_INIT;
+static fast_cpu_tier_t detected_tier = FAST_CPU_TIER_SCALAR;
+static fast_cpu_tier_t env_tier      = FAST_CPU_TIER_AUTO;
+static fast_cpu_tier_t forced_tier   = FAST_CPU_TIER_AUTO;
+
+static fast_cpu_tier_t
+detect_tier(void)
+{
+#ifdef FAST_X86_KERNELS
+    // libgcc also checks that the OS saves the AVX and AVX-512 register state
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vbmi")) {
+        return FAST_CPU_TIER_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return FAST_CPU_TIER_AVX2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return FAST_CPU_TIER_SSSE3;
+    }
+#endif
+    return FAST_CPU_TIER_SCALAR;
+}
+
+static fast_cpu_tier_t
+parse_tier(const char *name)
+{
+    if (!name) {
+        return FAST_CPU_TIER_AUTO;
+    }
+    for (size_t i = 0; i < sizeof(k_tier_names) / sizeof(k_tier_names[0]); i++) {
+        if (strcmp(name, k_tier_names[i]) == 0) {
+            return (fast_cpu_tier_t) i;
+        }
+    }
+    return FAST_CPU_TIER_AUTO;
+}
+
+static void
+detect_tiers(void)
+{
+    detected_tier = detect_tier();
+    env_tier      = parse_tier(getenv("FAST_CPU_TIER"));
+}
+
+static void
+probe_tiers(void)
+{
+    (void) pthread_once(&tiers_once, detect_tiers);
+}
+
+fast_cpu_tier_t
+fast_cpu_tier(void)
+{
+    probe_tiers();
+
+    fast_cpu_tier_t tier = detected_tier;
+    if (forced_tier != FAST_CPU_TIER_AUTO) {
+        tier = forced_tier;
+    } else if (env_tier != FAST_CPU_TIER_AUTO) {
+        tier = env_tier;
+    }
+
+    return tier < detected_tier ? tier : detected_tier;
+}
+
+int
+fast_set_cpu_tier(fast_cpu_tier_t tier)
+{
+    probe_tiers();
+
+    if (tier != FAST_CPU_TIER_AUTO && (tier < FAST_CPU_TIER_SCALAR || tier > detected_tier)) {
+        return -1;
+    }
+
+    forced_tier = tier;
+    return 0;
+}
+
+void
+fast_cpu_model(char *model, size_t size)
+{
+#ifdef FAST_X86_KERNELS
+    unsigned int brand[12];
+    if (__get_cpuid_max(0x80000000U, NULL) >= 0x80000004U) {
+        for (unsigned int i = 0; i < 3; i++) {
+            __get_cpuid(0x80000002U + i, &brand[4 * i], &brand[4 * i + 1], &brand[4 * i + 2],
+                        &brand[4 * i + 3]);
+        }
+
+        char text[sizeof(brand) + 1];
+        memcpy(text, brand, sizeof(brand));
+        text[sizeof(brand)] = '\0';
+
+        // Brand strings are space-padded; keep the name a single tab-free field
+        const char *start = text;
+        while (*start == ' ') {
+            start++;
+        }
+        size_t len = strlen(start);
+        while (len > 0 && start[len - 1] == ' ') {
+            len--;
+        }
+        if (len > 0) {
+            snprintf(model, size, "%.*s", (int) len, start);
+            for (char *c = model; *c; c++) {
+                *c = (*c == '\t') ? ' ' : *c;
+            }
+            return;
+        }
+    }
+#endif
+    snprintf(model, size, "unknown");
+}
+
+const char *
+fast_cpu_tier_name(fast_cpu_tier_t tier)
+{
+    if (tier == FAST_CPU_TIER_AUTO) {
+        return "auto";
+    }
+    if (tier < FAST_CPU_TIER_SCALAR || tier > FAST_CPU_TIER_AVX512) {
+        return NULL;
+    }
+    return k_tier_names[tier];
+}
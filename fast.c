@@ -4,28 +4,47 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Blocks of PRF output in the key material of a layer sequence
+#define FAST_SEQ_KEY_BLOCKS (FAST_DERIVED_KEY_SIZE / FAST_AES_BLOCK_SIZE)
+
 // Define the full context structure
 struct fast_context {
-    fast_params_t params;
-    sbox_pool_t  *sbox_pool;
-    uint8_t       master_key[FAST_MASTER_KEY_SIZE];
-    uint32_t     *seq_buffer;
-    size_t        seq_length;
-    uint8_t      *cached_tweak;
-    size_t        cached_tweak_len;
-    bool          has_cached_seq;
+    fast_params_t        params;
+    sbox_pool_t         *pools; // S-box pool of each replica
+    layer_program_t     *programs; // Program of the cached sequence over each replica's pool
+    uint32_t             replicas; // One per NUMA node (FAST_INIT_NUMA_REPLICAS), or 1
+    fast_arena_t        *replica_arenas; // Mapping of each replica, or NULL for a single pool
+    const fast_kernel_t *enc_kernel;
+    const fast_kernel_t *dec_kernel;
+    const fast_kernel_t *enc_batch_kernel;
+    const fast_kernel_t *dec_batch_kernel;
+    prf_t                prf; // CMAC under the master key, expanded once
+    cmac_state_t         seq_prefix[2][FAST_SEQ_KEY_BLOCKS]; // By long mode, prefix_sequence_key()
+    uint8_t             *seq_buffer; // seq_entry_size(sbox_count) bytes per layer
+    size_t               seq_length;
+    bool                 encrypts; // Encryption allowed (not FAST_INIT_DECRYPT_ONLY)
+    bool                 decrypts; // Decryption allowed (not FAST_INIT_ENCRYPT_ONLY)
+    bool                 jit; // Word kernels run per-tweak JIT code (FAST_INIT_JIT)
+    bool                 autotuned; // Kernels chosen by FAST_INIT_AUTOTUNE
+    uint8_t             *cached_tweak; // FAST_TWEAK_CACHE_SIZE bytes
+    size_t               cached_tweak_len;
+    bool                 cached_long; // Cached sequence is for the long-message mode
+    bool                 has_cached_seq;
+    fast_arena_t         arena; // Region holding the context and everything it points to
+    void                *heap_region; // That region when fast_init_ex() allocated it, or NULL
+    size_t               mapped_size; // Size of heap_region when it is a page mapping, or 0
 };
 
-typedef struct {
-    const uint8_t *data;
-    size_t         len;
-} prf_part_t;
+// Flags fast_init_into() rejects, as it cannot choose where the caller's memory lives
+#define FAST_INIT_PLACEMENT (FAST_INIT_HUGE_PAGES | FAST_INIT_NUMA_REPLICAS)
 
 static const uint8_t LABEL_INSTANCE1[] = "instance1";
 static const uint8_t LABEL_INSTANCE2[] = "instance2";
 static const uint8_t LABEL_FPE_POOL[]  = "FPE Pool";
 static const uint8_t LABEL_FPE_SEQ[]   = "FPE SEQ";
 static const uint8_t LABEL_TWEAK[]     = "tweak";
+static const uint8_t LABEL_LONG_TWEAK[] = "long tweak";
+static const uint8_t LABEL_LONG_MASK[]  = "FPE LONG MASK";
 
 static const uint32_t k_round_l_values[] = { 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 16, 32, 50, 64, 100 };
 static const uint32_t k_round_radices[]  = { 4,  5,  6,  7,   8,   9,   10,   11,   12,    13,
@@ -54,15 +73,6 @@ static const uint16_t k_round_table[][15] = {
     { 32, 22, 17, 17, 17, 17, 17, 18, 18, 19, 21, 26, 31, 35, 42 } // a = 65536
 };
 
-static void
-write_u32_be(uint32_t value, uint8_t out[4])
-{
-    out[0] = (uint8_t) ((value >> 24) & 0xFF);
-    out[1] = (uint8_t) ((value >> 16) & 0xFF);
-    out[2] = (uint8_t) ((value >> 8) & 0xFF);
-    out[3] = (uint8_t) (value & 0xFF);
-}
-
 static double
 interpolate(double x, double x0, double x1, double y0, double y1)
 {
@@ -134,46 +144,9 @@ lookup_recommended_rounds(uint32_t radix, double ell)
     return rounds_for_row(radix_count - 1, ell);
 }
 
+// Key material of the S-box pool
 static int
-encode_parts(uint8_t **out, size_t *out_len, const prf_part_t *parts, size_t part_count)
-{
-    if (!out || !out_len || (!parts && part_count > 0)) {
-        return -1;
-    }
-
-    size_t total = sizeof(uint32_t);
-    for (size_t i = 0; i < part_count; i++) {
-        total += sizeof(uint32_t) + parts[i].len;
-        if (parts[i].len > 0 && !parts[i].data) {
-            return -1;
-        }
-    }
-
-    uint8_t *buffer = malloc(total);
-    if (!buffer) {
-        return -1;
-    }
-
-    uint8_t *cursor = buffer;
-    write_u32_be((uint32_t) part_count, cursor);
-    cursor += sizeof(uint32_t);
-
-    for (size_t i = 0; i < part_count; i++) {
-        write_u32_be((uint32_t) parts[i].len, cursor);
-        cursor += sizeof(uint32_t);
-        if (parts[i].len > 0) {
-            memcpy(cursor, parts[i].data, parts[i].len);
-            cursor += parts[i].len;
-        }
-    }
-
-    *out     = buffer;
-    *out_len = total;
-    return 0;
-}
-
-static int
-build_setup1_input(const fast_params_t *params, uint8_t **out, size_t *out_len)
+derive_pool_key(const prf_t *prf, const fast_params_t *params, uint8_t *out, size_t out_len)
 {
     uint8_t a_be[4];
     uint8_t m_be[4];
@@ -185,12 +158,15 @@ build_setup1_input(const fast_params_t *params, uint8_t **out, size_t *out_len)
                            { m_be, sizeof(m_be) },
                            { LABEL_FPE_POOL, sizeof(LABEL_FPE_POOL) - 1 } };
 
-    return encode_parts(out, out_len, parts, sizeof(parts) / sizeof(parts[0]));
+    return prf_derive(prf, parts, sizeof(parts) / sizeof(parts[0]), out, out_len);
 }
 
+// The input the key of a tweak's layer sequence derives from is these parameters, then the tweak.
+// The PRF state after everything but the tweak is kept for each block of the key, so that a new
+// tweak only costs the blocks the tweak adds to the MAC and the final ones.
 static int
-build_setup2_input(const fast_params_t *params, const uint8_t *tweak, size_t tweak_len,
-                   uint8_t **out, size_t *out_len)
+prefix_sequence_key(const prf_t *prf, const fast_params_t *params, bool long_mode,
+                    cmac_state_t states[FAST_SEQ_KEY_BLOCKS])
 {
     uint8_t a_be[4];
     uint8_t m_be[4];
@@ -199,6 +175,11 @@ build_setup2_input(const fast_params_t *params, const uint8_t *tweak, size_t twe
     uint8_t w_be[4];
     uint8_t wp_be[4];
 
+    // The long-message mode gets sequences of its own, so that its blocks can never be decrypted
+    // through fast_decrypt() with a chosen tweak
+    const uint8_t *label     = long_mode ? LABEL_LONG_TWEAK : LABEL_TWEAK;
+    const size_t   label_len = long_mode ? sizeof(LABEL_LONG_TWEAK) - 1 : sizeof(LABEL_TWEAK) - 1;
+
     write_u32_be(params->radix, a_be);
     write_u32_be(params->sbox_count, m_be);
     write_u32_be(params->word_length, ell_be);
@@ -215,37 +196,88 @@ build_setup2_input(const fast_params_t *params, const uint8_t *tweak, size_t twe
                            { w_be, sizeof(w_be) },
                            { wp_be, sizeof(wp_be) },
                            { LABEL_FPE_SEQ, sizeof(LABEL_FPE_SEQ) - 1 },
-                           { LABEL_TWEAK, sizeof(LABEL_TWEAK) - 1 },
-                           { tweak, tweak_len } };
+                           { label, label_len } };
+
+    // The tweak is the last part
+    const size_t count = sizeof(parts) / sizeof(parts[0]);
+    return prf_prefix(prf, count + 1, parts, count, states, FAST_SEQ_KEY_BLOCKS);
+}
 
-    return encode_parts(out, out_len, parts, sizeof(parts) / sizeof(parts[0]));
+// Replica the calling thread reads
+static inline const layer_program_t *
+local_program(const fast_context_t *ctx)
+{
+    return &ctx->programs[ctx->replicas > 1 ? fast_numa_node() % ctx->replicas : 0];
+}
+
+// Compiles the sequence buffer into the program of every replica
+static int
+compile_programs(fast_context_t *ctx)
+{
+    for (uint32_t r = 0; r < ctx->replicas; r++) {
+        if (fast_compile_program(&ctx->programs[r], &ctx->pools[r], ctx->seq_buffer,
+                                 ctx->params.num_layers) != 0) {
+            return -1;
+        }
+        // Not fatal: without code for this tweak the JIT kernels run the generic loop
+        if (ctx->jit) {
+            (void) fast_jit_compile(&ctx->programs[r], &ctx->params);
+        }
+    }
+    return 0;
+}
+
+// Replica mappings are read-only but while their pools are built
+static int
+protect_replicas(const fast_context_t *ctx, bool writable)
+{
+    if (!ctx->replica_arenas) {
+        return 0;
+    }
+    for (uint32_t r = 0; r < ctx->replicas; r++) {
+        const fast_arena_t *arena = &ctx->replica_arenas[r];
+        if (arena->base && fast_pages_protect(arena->base, arena->size, writable) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void
+unmap_replicas(fast_context_t *ctx)
+{
+    if (!ctx->replica_arenas) {
+        return;
+    }
+    for (uint32_t r = 0; r < ctx->replicas; r++) {
+        fast_pages_unmap(ctx->replica_arenas[r].base, ctx->replica_arenas[r].size);
+        ctx->replica_arenas[r].base = NULL;
+    }
 }
 
 static int
-ensure_sequence(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len)
+ensure_sequence(fast_context_t *ctx, bool long_mode, const uint8_t *tweak, size_t tweak_len)
 {
     if (!ctx) {
         return -1;
     }
 
-    if (ctx->has_cached_seq && ctx->cached_tweak_len == tweak_len) {
-        if (tweak_len == 0 ||
-            (ctx->cached_tweak && tweak && memcmp(ctx->cached_tweak, tweak, tweak_len) == 0)) {
+    if (ctx->has_cached_seq && ctx->cached_long == long_mode &&
+        ctx->cached_tweak_len == tweak_len) {
+        if (tweak_len == 0 || (tweak && memcmp(ctx->cached_tweak, tweak, tweak_len) == 0)) {
             return 0;
         }
     }
 
-    uint8_t *input     = NULL;
-    size_t   input_len = 0;
-    uint8_t  kseq_material[FAST_DERIVED_KEY_SIZE];
-    int      status = -1;
+    uint8_t kseq_material[FAST_DERIVED_KEY_SIZE];
+    int     status = -1;
 
-    if (build_setup2_input(&ctx->params, tweak, tweak_len, &input, &input_len) != 0) {
-        return -1;
-    }
+    // The sequence buffer is about to be overwritten
+    ctx->has_cached_seq = false;
 
-    if (prf_derive_key(ctx->master_key, input, input_len, kseq_material, sizeof(kseq_material)) !=
-        0) {
+    const prf_part_t tweak_part = { tweak, tweak_len };
+    if (prf_finish(&ctx->prf, ctx->seq_prefix[long_mode], FAST_SEQ_KEY_BLOCKS, &tweak_part, 1,
+                   kseq_material, sizeof(kseq_material)) != 0) {
         goto cleanup;
     }
 
@@ -254,40 +286,91 @@ ensure_sequence(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len)
         goto cleanup;
     }
 
-    uint8_t *new_cache = NULL;
-    if (tweak_len > 0) {
-        new_cache = malloc(tweak_len);
-        if (!new_cache) {
-            goto cleanup;
-        }
-        memcpy(new_cache, tweak, tweak_len);
+    if (compile_programs(ctx) != 0) {
+        goto cleanup;
     }
 
-    free(ctx->cached_tweak);
-    ctx->cached_tweak     = new_cache;
-    ctx->cached_tweak_len = tweak_len;
-    ctx->has_cached_seq   = true;
+    // Longer tweaks are not cached, and derive their sequence again on the next call
+    if (tweak_len <= FAST_TWEAK_CACHE_SIZE) {
+        if (tweak_len > 0) {
+            memcpy(ctx->cached_tweak, tweak, tweak_len);
+        }
+        ctx->cached_tweak_len = tweak_len;
+        ctx->cached_long      = long_mode;
+        ctx->has_cached_seq   = true;
+    }
 
     status = 0;
 
 cleanup:
-    if (input) {
-        free(input);
-    }
     memset(kseq_material, 0, sizeof(kseq_material));
-    if (status != 0 && tweak_len > 0) {
-        // new_cache freed by free(ctx->cached_tweak) only on success
-        if (ctx->cached_tweak != new_cache) {
-            free(new_cache);
+    return status;
+}
+
+// Checks that the context serves a direction. The first decryption of a context serving both
+// builds its inverse tables, in every replica, and recompiles the current programs to take them
+// in.
+static int
+ensure_direction(fast_context_t *ctx, bool decrypt)
+{
+    if (!(decrypt ? ctx->decrypts : ctx->encrypts)) {
+        return -1;
+    }
+    // Replicas are built in order, so the last one having them means they all do
+    if (!decrypt || ctx->pools[ctx->replicas - 1].inv_slab) {
+        return 0;
+    }
+    if (protect_replicas(ctx, true) != 0) {
+        return -1;
+    }
+    int status = 0;
+    for (uint32_t r = 0; r < ctx->replicas && status == 0; r++) {
+        status = build_inverse_tables(&ctx->pools[r]);
+    }
+    (void) protect_replicas(ctx, false);
+    if (status != 0) {
+        return -1;
+    }
+    if (ctx->has_cached_seq && compile_programs(ctx) != 0) {
+        ctx->has_cached_seq = false;
+        return -1;
+    }
+    return 0;
+}
+
+// Also rejects contexts with wide symbols, which the byte entry points cannot carry
+static int
+check_symbols(const fast_context_t *ctx, const uint8_t *data, size_t length)
+{
+    if (ctx->params.radix > FAST_MAX_RADIX) {
+        return -1;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] >= ctx->params.radix) {
+            return -1;
         }
     }
-    return status;
+    return 0;
+}
+
+static int
+check_symbols16(const fast_context_t *ctx, const uint16_t *data, size_t length)
+{
+    if (ctx->params.radix <= FAST_MAX_RADIX) {
+        return -1;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] >= ctx->params.radix) {
+            return -1;
+        }
+    }
+    return 0;
 }
 
 int
 calculate_recommended_params(fast_params_t *params, uint32_t radix, uint32_t word_length)
 {
-    if (!params || radix < 4 || word_length < 2) {
+    if (!params || radix < 4 || radix > FAST_MAX_RADIX16 || word_length < 2) {
         return -1;
     }
 
@@ -320,11 +403,20 @@ calculate_recommended_params(fast_params_t *params, uint32_t radix, uint32_t wor
 int
 fast_init(fast_context_t **ctx, const fast_params_t *params, const uint8_t *key)
 {
-    if (!ctx || !params || !key) {
+    return fast_init_ex(ctx, params, key, 0);
+}
+
+// Checks shared by fast_context_size(), fast_init_ex() and fast_init_into()
+static int
+check_init_args(const fast_params_t *params, uint32_t flags)
+{
+    if ((flags & ~(FAST_INIT_JIT | FAST_INIT_AUTOTUNE | FAST_INIT_ENCRYPT_ONLY |
+                   FAST_INIT_DECRYPT_ONLY | FAST_INIT_PLACEMENT)) != 0 ||
+        ((flags & FAST_INIT_ENCRYPT_ONLY) && (flags & FAST_INIT_DECRYPT_ONLY))) {
         return -1;
     }
 
-    if (params->radix < 4 || params->radix > FAST_MAX_RADIX) {
+    if (params->radix < 4 || params->radix > FAST_MAX_RADIX16) {
         return -1;
     }
 
@@ -333,7 +425,7 @@ fast_init(fast_context_t **ctx, const fast_params_t *params, const uint8_t *key)
         return -1;
     }
 
-    if (params->sbox_count == 0) {
+    if (params->sbox_count == 0 || params->sbox_count > FAST_MAX_SBOX_COUNT) {
         return -1;
     }
 
@@ -346,73 +438,254 @@ fast_init(fast_context_t **ctx, const fast_params_t *params, const uint8_t *key)
         return -1;
     }
 
-    fast_context_t *tmp = calloc(1, sizeof(fast_context_t));
-    if (!tmp) {
+    return 0;
+}
+
+// Directions a context reserves pool memory for: a two-way context has room for the inverse tables
+// it builds on its first decryption
+static uint32_t
+reserved_directions(uint32_t flags)
+{
+    if (flags & FAST_INIT_ENCRYPT_ONLY) {
+        return FAST_SBOX_FORWARD;
+    }
+    if (flags & FAST_INIT_DECRYPT_ONLY) {
+        return FAST_SBOX_INVERSE;
+    }
+    return FAST_SBOX_FORWARD | FAST_SBOX_INVERSE;
+}
+
+// Bytes of the region of a context with this many pool replicas. A single pool lives in the
+// region; replicas live in mappings of their own, so the region only holds their bookkeeping.
+static size_t
+region_size(const fast_params_t *params, uint32_t flags, uint32_t replicas)
+{
+    const size_t seq_bytes = (size_t) params->num_layers * seq_entry_size(params->sbox_count);
+
+    // Slack to align the start of an arbitrary buffer on a cache line
+    size_t bytes = FAST_CACHE_LINE - 1 + arena_bytes(sizeof(fast_context_t)) +
+                   arena_bytes(replicas * sizeof(sbox_pool_t)) +
+                   arena_bytes(replicas * sizeof(layer_program_t)) + arena_bytes(seq_bytes) +
+                   arena_bytes(FAST_TWEAK_CACHE_SIZE);
+    if (replicas > 1) {
+        bytes += arena_bytes(replicas * sizeof(fast_arena_t));
+    } else {
+        bytes += sbox_pool_size(params->sbox_count, params->radix, reserved_directions(flags));
+    }
+    return bytes;
+}
+
+size_t
+fast_context_size(const fast_params_t *params, uint32_t flags)
+{
+    if (!params || (flags & FAST_INIT_PLACEMENT) || check_init_args(params, flags) != 0) {
+        return 0;
+    }
+    return region_size(params, flags, 1);
+}
+
+// Maps the memory of each replica on its node, with room for the inverse tables built later
+static int
+map_replicas(fast_context_t *ctx, uint32_t flags)
+{
+    const size_t bytes =
+        sbox_pool_size(ctx->params.sbox_count, ctx->params.radix, reserved_directions(flags));
+
+    for (uint32_t r = 0; r < ctx->replicas; r++) {
+        size_t   size  = bytes;
+        uint8_t *pages = fast_pages_map(&size, (flags & FAST_INIT_HUGE_PAGES) != 0, (int32_t) r);
+        if (!pages) {
+            unmap_replicas(ctx);
+            return -1;
+        }
+        ctx->replica_arenas[r] = (fast_arena_t) { pages, size, 0 };
+    }
+    return 0;
+}
+
+// Generates the pool into the first replica and copies it to the others, which are then made
+// read-only
+static int
+generate_replicas(fast_context_t *ctx, const uint8_t *key_material, size_t key_len,
+                  uint32_t directions)
+{
+    fast_arena_t *arena = ctx->replica_arenas ? &ctx->replica_arenas[0] : &ctx->arena;
+
+    if (fast_generate_sbox_pool(&ctx->pools[0], ctx->params.sbox_count, ctx->params.radix,
+                                key_material, key_len, directions, arena) != 0) {
+        return -1;
+    }
+    for (uint32_t r = 1; r < ctx->replicas; r++) {
+        if (copy_sbox_pool(&ctx->pools[r], &ctx->pools[0], &ctx->replica_arenas[r]) != 0) {
+            return -1;
+        }
+    }
+    // Not fatal: the tables are only ever read outside of ensure_direction()
+    (void) protect_replicas(ctx, false);
+    return 0;
+}
+
+// Lays out a context in buffer, with its pool replicated replicas times
+static int
+init_context(fast_context_t **ctx, void *buffer, size_t size, const fast_params_t *params,
+             const uint8_t *key, uint32_t flags, uint32_t replicas)
+{
+    if (!ctx || !buffer || !params || !key || check_init_args(params, flags) != 0 ||
+        size < region_size(params, flags, replicas)) {
         return -1;
     }
 
-    tmp->params = *params;
+    // Everything the context holds is carved from the buffer, starting with the context itself
+    const size_t skew  = (FAST_CACHE_LINE - (uintptr_t) buffer % FAST_CACHE_LINE) % FAST_CACHE_LINE;
+    fast_arena_t arena = { (uint8_t *) buffer + skew, size - skew, 0 };
+
+    fast_context_t *tmp = arena_alloc(&arena, sizeof(fast_context_t));
+    memset(tmp, 0, sizeof(fast_context_t));
+    tmp->arena = arena;
+
+    tmp->params   = *params;
+    tmp->encrypts = (flags & FAST_INIT_DECRYPT_ONLY) == 0;
+    tmp->decrypts = (flags & FAST_INIT_ENCRYPT_ONLY) == 0;
     if (tmp->params.security_level == 0) {
         tmp->params.security_level = 128;
     }
 
-    tmp->seq_length = tmp->params.num_layers;
-    tmp->seq_buffer = malloc(tmp->seq_length * sizeof(uint32_t));
-    if (!tmp->seq_buffer) {
-        free(tmp);
-        return -1;
+    tmp->seq_length   = tmp->params.num_layers;
+    tmp->seq_buffer   = arena_alloc(&tmp->arena,
+                                    tmp->seq_length * seq_entry_size(tmp->params.sbox_count));
+    tmp->cached_tweak = arena_alloc(&tmp->arena, FAST_TWEAK_CACHE_SIZE);
+    tmp->replicas     = replicas;
+    tmp->pools        = arena_alloc(&tmp->arena, replicas * sizeof(sbox_pool_t));
+    tmp->programs     = arena_alloc(&tmp->arena, replicas * sizeof(layer_program_t));
+    memset(tmp->programs, 0, replicas * sizeof(layer_program_t));
+    if (replicas > 1) {
+        tmp->replica_arenas = arena_alloc(&tmp->arena, replicas * sizeof(fast_arena_t));
+        memset(tmp->replica_arenas, 0, replicas * sizeof(fast_arena_t));
+        if (map_replicas(tmp, flags) != 0) {
+            return -1;
+        }
     }
 
-    memcpy(tmp->master_key, key, FAST_MASTER_KEY_SIZE);
+    uint8_t pool_key_material[FAST_DERIVED_KEY_SIZE];
+    int     status = -1;
 
-    uint8_t *setup1_input = NULL;
-    size_t   setup1_len   = 0;
-    uint8_t  pool_key_material[FAST_DERIVED_KEY_SIZE];
+    if (prf_init(&tmp->prf, key) != 0) {
+        goto cleanup;
+    }
 
-    if (build_setup1_input(&tmp->params, &setup1_input, &setup1_len) != 0) {
-        free(tmp->seq_buffer);
-        free(tmp);
-        return -1;
+    if (derive_pool_key(&tmp->prf, &tmp->params, pool_key_material, sizeof(pool_key_material)) !=
+            0 ||
+        prefix_sequence_key(&tmp->prf, &tmp->params, false, tmp->seq_prefix[false]) != 0 ||
+        prefix_sequence_key(&tmp->prf, &tmp->params, true, tmp->seq_prefix[true]) != 0) {
+        goto cleanup;
+    }
+
+    // Inverse tables wait for the first decryption, unless the autotuner is about to time it
+    const uint32_t directions = !tmp->encrypts ? FAST_SBOX_INVERSE
+                                : tmp->decrypts && (flags & FAST_INIT_AUTOTUNE)
+                                    ? FAST_SBOX_FORWARD | FAST_SBOX_INVERSE
+                                    : FAST_SBOX_FORWARD;
+    if (generate_replicas(tmp, pool_key_material, sizeof(pool_key_material), directions) != 0) {
+        goto cleanup;
+    }
+
+    // The generic and wide kernels support every parameter set and CPU between them, so selection
+    // cannot fail. Replicas only differ in where their tables are.
+    const fast_cpu_tier_t tier = fast_cpu_tier();
+    const sbox_pool_t    *pool = &tmp->pools[0];
+
+    tmp->enc_kernel       = fast_select_kernel(fast_encrypt_kernels, &tmp->params, pool, tier);
+    tmp->dec_kernel       = fast_select_kernel(fast_decrypt_kernels, &tmp->params, pool, tier);
+    tmp->enc_batch_kernel =
+        fast_select_batch_kernel(fast_encrypt_kernels, &tmp->params, pool, tier);
+    tmp->dec_batch_kernel =
+        fast_select_batch_kernel(fast_decrypt_kernels, &tmp->params, pool, tier);
+
+    fast_kernel_set_t tuned = { tmp->enc_kernel, tmp->dec_kernel, tmp->enc_batch_kernel,
+                                tmp->dec_batch_kernel };
+    if ((flags & FAST_INIT_AUTOTUNE) &&
+        fast_autotune(&tuned, &tmp->params, pool, tier, (flags & FAST_INIT_JIT) != 0) == 0) {
+        tmp->enc_kernel       = tuned.enc;
+        tmp->dec_kernel       = tuned.dec;
+        tmp->enc_batch_kernel = tuned.enc_batch;
+        tmp->dec_batch_kernel = tuned.dec_batch;
+        tmp->autotuned        = true;
+    } else if ((flags & FAST_INIT_JIT) && fast_jit_encrypt_kernel.supports(&tmp->params, pool)) {
+        tmp->enc_kernel = &fast_jit_encrypt_kernel;
+        tmp->dec_kernel = &fast_jit_decrypt_kernel;
     }
+    tmp->jit = tmp->enc_kernel == &fast_jit_encrypt_kernel ||
+               tmp->dec_kernel == &fast_jit_decrypt_kernel;
 
-    if (prf_derive_key(tmp->master_key, setup1_input, setup1_len, pool_key_material,
-                       sizeof(pool_key_material)) != 0) {
-        free(setup1_input);
-        free(tmp->seq_buffer);
-        memset(tmp->master_key, 0, sizeof(tmp->master_key));
-        free(tmp);
-        memset(pool_key_material, 0, sizeof(pool_key_material));
+    *ctx   = tmp;
+    status = 0;
+
+cleanup:
+    memset(pool_key_material, 0, sizeof(pool_key_material));
+    if (status != 0) {
+        prf_cleanup(&tmp->prf);
+        memset(tmp->seq_prefix, 0, sizeof(tmp->seq_prefix));
+        unmap_replicas(tmp);
+    }
+    return status;
+}
+
+int
+fast_init_ex(fast_context_t **ctx, const fast_params_t *params, const uint8_t *key,
+             uint32_t flags)
+{
+    if (!ctx || !params || check_init_args(params, flags) != 0) {
         return -1;
     }
 
-    free(setup1_input);
+    const uint32_t replicas = (flags & FAST_INIT_NUMA_REPLICAS) ? fast_numa_nodes() : 1;
+    const bool     huge     = (flags & FAST_INIT_HUGE_PAGES) != 0;
+    size_t         size     = region_size(params, flags, replicas);
 
-    tmp->sbox_pool = malloc(sizeof(sbox_pool_t));
-    if (!tmp->sbox_pool) {
-        memset(pool_key_material, 0, sizeof(pool_key_material));
-        free(tmp->seq_buffer);
-        memset(tmp->master_key, 0, sizeof(tmp->master_key));
-        free(tmp);
+    void *region = huge ? fast_pages_map(&size, true, -1) : malloc(size);
+    if (!region) {
         return -1;
     }
 
-    if (fast_generate_sbox_pool(tmp->sbox_pool, tmp->params.sbox_count, tmp->params.radix,
-                                pool_key_material, sizeof(pool_key_material)) != 0) {
-        memset(pool_key_material, 0, sizeof(pool_key_material));
-        free(tmp->sbox_pool);
-        free(tmp->seq_buffer);
-        memset(tmp->master_key, 0, sizeof(tmp->master_key));
-        free(tmp);
+    fast_context_t *tmp = NULL;
+    if (init_context(&tmp, region, size, params, key, flags, replicas) != 0) {
+        if (huge) {
+            fast_pages_unmap(region, size);
+        } else {
+            free(region);
+        }
         return -1;
     }
+    tmp->heap_region = region;
+    tmp->mapped_size = huge ? size : 0;
 
-    memset(pool_key_material, 0, sizeof(pool_key_material));
+    *ctx = tmp;
+    return 0;
+}
 
-    tmp->cached_tweak     = NULL;
-    tmp->cached_tweak_len = 0;
-    tmp->has_cached_seq   = false;
+int
+fast_init_into(fast_context_t **ctx, void *buffer, size_t size, const fast_params_t *params,
+               const uint8_t *key, uint32_t flags)
+{
+    if (flags & FAST_INIT_PLACEMENT) {
+        return -1;
+    }
+    return init_context(ctx, buffer, size, params, key, flags, 1);
+}
+
+int
+fast_get_kernel_info(const fast_context_t *ctx, fast_kernel_info_t *info)
+{
+    if (!ctx || !info) {
+        return -1;
+    }
+
+    info->encrypt       = ctx->enc_kernel->name;
+    info->decrypt       = ctx->dec_kernel->name;
+    info->encrypt_batch = ctx->enc_batch_kernel->name;
+    info->decrypt_batch = ctx->dec_batch_kernel->name;
+    info->autotuned     = ctx->autotuned;
 
-    *ctx = tmp;
     return 0;
 }
 
@@ -423,25 +696,22 @@ fast_cleanup(fast_context_t *ctx)
         return;
     }
 
-    if (ctx->sbox_pool) {
-        free_sbox_pool(ctx->sbox_pool);
-        free(ctx->sbox_pool);
-        ctx->sbox_pool = NULL;
+    // Everything else lives in the context's region
+    for (uint32_t r = 0; r < ctx->replicas; r++) {
+        fast_jit_release(&ctx->programs[r]);
     }
+    unmap_replicas(ctx);
 
-    if (ctx->seq_buffer) {
-        free(ctx->seq_buffer);
-        ctx->seq_buffer = NULL;
-    }
-
-    if (ctx->cached_tweak) {
-        free(ctx->cached_tweak);
-        ctx->cached_tweak = NULL;
-    }
-
-    memset(ctx->master_key, 0, sizeof(ctx->master_key));
+    void        *heap_region = ctx->heap_region;
+    const size_t mapped_size = ctx->mapped_size;
+    prf_cleanup(&ctx->prf);
+    memset(ctx->seq_prefix, 0, sizeof(ctx->seq_prefix));
     memset(&ctx->params, 0, sizeof(fast_params_t));
-    free(ctx);
+    if (mapped_size > 0) {
+        fast_pages_unmap(heap_region, mapped_size);
+    } else {
+        free(heap_region);
+    }
 }
 
 int
@@ -460,18 +730,20 @@ fast_encrypt(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len, const
         return -1;
     }
 
-    if (ensure_sequence(ctx, tweak, tweak_len) != 0) {
+    if (ensure_direction(ctx, false) != 0) {
         return -1;
     }
 
-    for (size_t i = 0; i < length; i++) {
-        if (plaintext[i] >= ctx->params.radix) {
-            return -1;
-        }
+    if (ensure_sequence(ctx, false, tweak, tweak_len) != 0) {
+        return -1;
     }
 
-    fast_cenc(&ctx->params, ctx->sbox_pool, ctx->seq_buffer, plaintext, ciphertext, length);
-    return 0;
+    if (check_symbols(ctx, plaintext, length) != 0) {
+        return -1;
+    }
+
+    return fast_cenc(ctx->enc_kernel, &ctx->params, local_program(ctx), plaintext,
+                     ciphertext, length);
 }
 
 int
@@ -490,16 +762,403 @@ fast_decrypt(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len, const
         return -1;
     }
 
-    if (ensure_sequence(ctx, tweak, tweak_len) != 0) {
+    if (ensure_direction(ctx, true) != 0) {
         return -1;
     }
 
-    for (size_t i = 0; i < length; i++) {
-        if (ciphertext[i] >= ctx->params.radix) {
+    if (ensure_sequence(ctx, false, tweak, tweak_len) != 0) {
+        return -1;
+    }
+
+    if (check_symbols(ctx, ciphertext, length) != 0) {
+        return -1;
+    }
+
+    return fast_cdec(ctx->dec_kernel, &ctx->params, local_program(ctx), ciphertext,
+                     plaintext, length);
+}
+
+int
+fast_encrypt_batch(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                   const uint8_t *plaintexts, uint8_t *ciphertexts, size_t length, size_t count)
+{
+    if (!ctx || !plaintexts || !ciphertexts) {
+        return -1;
+    }
+
+    if (length != ctx->params.word_length || count > SIZE_MAX / length) {
+        return -1;
+    }
+
+    if (tweak_len > 0 && !tweak) {
+        return -1;
+    }
+
+    if (ensure_direction(ctx, false) != 0) {
+        return -1;
+    }
+
+    if (ensure_sequence(ctx, false, tweak, tweak_len) != 0) {
+        return -1;
+    }
+
+    if (check_symbols(ctx, plaintexts, length * count) != 0) {
+        return -1;
+    }
+
+    return fast_cenc_batch(ctx->enc_batch_kernel, &ctx->params, local_program(ctx), plaintexts,
+                           ciphertexts, length, count);
+}
+
+int
+fast_decrypt_batch(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                   const uint8_t *ciphertexts, uint8_t *plaintexts, size_t length, size_t count)
+{
+    if (!ctx || !ciphertexts || !plaintexts) {
+        return -1;
+    }
+
+    if (length != ctx->params.word_length || count > SIZE_MAX / length) {
+        return -1;
+    }
+
+    if (tweak_len > 0 && !tweak) {
+        return -1;
+    }
+
+    if (ensure_direction(ctx, true) != 0) {
+        return -1;
+    }
+
+    if (ensure_sequence(ctx, false, tweak, tweak_len) != 0) {
+        return -1;
+    }
+
+    if (check_symbols(ctx, ciphertexts, length * count) != 0) {
+        return -1;
+    }
+
+    return fast_cdec_batch(ctx->dec_batch_kernel, &ctx->params, local_program(ctx), ciphertexts,
+                           plaintexts, length, count);
+}
+
+int
+fast_encrypt16(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+               const uint16_t *plaintext, uint16_t *ciphertext, size_t length)
+{
+    if (!ctx || !plaintext || !ciphertext) {
+        return -1;
+    }
+
+    if (length != ctx->params.word_length) {
+        return -1;
+    }
+
+    if (tweak_len > 0 && !tweak) {
+        return -1;
+    }
+
+    if (ensure_direction(ctx, false) != 0) {
+        return -1;
+    }
+
+    if (ensure_sequence(ctx, false, tweak, tweak_len) != 0) {
+        return -1;
+    }
+
+    if (check_symbols16(ctx, plaintext, length) != 0) {
+        return -1;
+    }
+
+    return fast_cenc16(ctx->enc_kernel, &ctx->params, local_program(ctx), plaintext,
+                       ciphertext, length);
+}
+
+int
+fast_decrypt16(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+               const uint16_t *ciphertext, uint16_t *plaintext, size_t length)
+{
+    if (!ctx || !ciphertext || !plaintext) {
+        return -1;
+    }
+
+    if (length != ctx->params.word_length) {
+        return -1;
+    }
+
+    if (tweak_len > 0 && !tweak) {
+        return -1;
+    }
+
+    if (ensure_direction(ctx, true) != 0) {
+        return -1;
+    }
+
+    if (ensure_sequence(ctx, false, tweak, tweak_len) != 0) {
+        return -1;
+    }
+
+    if (check_symbols16(ctx, ciphertext, length) != 0) {
+        return -1;
+    }
+
+    return fast_cdec16(ctx->dec_kernel, &ctx->params, local_program(ctx), ciphertext,
+                       plaintext, length);
+}
+
+// Long-message mode
+//
+// A message of L >= B symbols, with B the word length, is cut into n = ceil(L / B) blocks of B
+// symbols: block i < n - 1 starts at i * B, and the last one at L - B, overlapping the one before
+// it when B does not divide L. Every block is encrypted twice as a word, under the long-mode
+// sequence of the tweak, in two chained passes done in place, with modular addition:
+//   - forward, blocks 0 to n - 1: X_i = E(P_i + IV1 + before_i), with before_i the B symbols
+//     before the block, zero-extended on the left
+//   - backward, blocks n - 1 to 0: C_i = E(X_i + IV2 + after_i), with after_i the B symbols after
+//     the block, zero-extended on the right
+// The neighbours are ciphertext of the pass by the time they are read, so a change anywhere
+// reaches the blocks after it through the first pass and those before it through the second.
+// IV1 || IV2 = PRF(LABEL_LONG_MASK, tweak, L) is 2B symbols, 4 PRF bytes each reduced mod radix.
+//
+// Each pass chains its blocks, so encryption is sequential. Decryption is not: every chain is
+// ciphertext of the pass being undone, so the blocks of a pass, bar the last block, which overlaps
+// a neighbour, are decrypted as a single batch.
+
+// Bytes of a long-mode buffer holding the two IVs and masks for the given number of blocks. The
+// PRF output the IVs are reduced from is derived in place, so it is at least that long.
+static size_t
+long_buffer_size(size_t ell, size_t blocks)
+{
+    return ell * (2 + (blocks > 6 ? blocks : 6));
+}
+
+// Writes IV1 || IV2 to the first 2 * ell bytes of a buffer of long_buffer_size()
+static int
+long_ivs(const fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len, size_t length,
+         uint8_t *buffer)
+{
+    const size_t ell = ctx->params.word_length;
+    uint8_t      length_be[4];
+
+    write_u32_be((uint32_t) length, length_be);
+
+    prf_part_t parts[] = { { LABEL_LONG_MASK, sizeof(LABEL_LONG_MASK) - 1 },
+                           { tweak, tweak_len },
+                           { length_be, sizeof(length_be) } };
+
+    if (prf_derive(&ctx->prf, parts, sizeof(parts) / sizeof(parts[0]), buffer, 8 * ell) != 0) {
+        memset(buffer, 0, 8 * ell);
+        return -1;
+    }
+    // Symbol j only overwrites bytes already read
+    for (size_t j = 0; j < 2 * ell; j++) {
+        buffer[j] = (uint8_t) (read_u32_be(buffer + 4 * j) % ctx->params.radix);
+    }
+    memset(buffer + 2 * ell, 0, 6 * ell);
+    return 0;
+}
+
+static size_t
+block_start(size_t i, size_t count, size_t length, size_t ell)
+{
+    return i + 1 == count ? length - ell : i * ell;
+}
+
+// Mask of the block at start in the forward pass: IV1 plus the ell symbols before it
+static void
+mask_before(const uint8_t *message, size_t start, size_t ell, uint32_t radix, const uint8_t *iv,
+            uint8_t *mask)
+{
+    const size_t missing = start < ell ? ell - start : 0;
+
+    memcpy(mask, iv, missing);
+    for (size_t j = missing; j < ell; j++) {
+        mask[j] = mod_add(iv[j], message[start - ell + j], radix);
+    }
+}
+
+// Mask of the block at start in the backward pass: IV2 plus the ell symbols after it
+static void
+mask_after(const uint8_t *message, size_t length, size_t start, size_t ell, uint32_t radix,
+           const uint8_t *iv, uint8_t *mask)
+{
+    const size_t from    = start + ell;
+    const size_t present = length - from < ell ? length - from : ell;
+
+    for (size_t j = 0; j < present; j++) {
+        mask[j] = mod_add(iv[j], message[from + j], radix);
+    }
+    memcpy(mask + present, iv + present, ell - present);
+}
+
+static int
+check_long_args(const fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                const uint8_t *input, const uint8_t *output, size_t length)
+{
+    if (!ctx || !input || !output || (tweak_len > 0 && !tweak)) {
+        return -1;
+    }
+    if (length < ctx->params.word_length || length > UINT32_MAX) {
+        return -1;
+    }
+    return check_symbols(ctx, input, length);
+}
+
+// One encryption pass over the message, in place
+static int
+encrypt_pass(const fast_context_t *ctx, const layer_program_t *prog, uint8_t *message,
+             size_t length, const uint8_t *iv, uint8_t *mask, bool backward)
+{
+    const size_t   ell   = ctx->params.word_length;
+    const size_t   count = (length + ell - 1) / ell;
+    const uint32_t radix = ctx->params.radix;
+
+    for (size_t k = 0; k < count; k++) {
+        const size_t start = block_start(backward ? count - 1 - k : k, count, length, ell);
+        uint8_t     *block = message + start;
+
+        if (backward) {
+            mask_after(message, length, start, ell, radix, iv, mask);
+        } else {
+            mask_before(message, start, ell, radix, iv, mask);
+        }
+        for (size_t j = 0; j < ell; j++) {
+            block[j] = mod_add(block[j], mask[j], radix);
+        }
+        if (fast_cenc(ctx->enc_kernel, &ctx->params, prog, block, block, ell) != 0) {
             return -1;
         }
     }
+    return 0;
+}
 
-    fast_cdec(&ctx->params, ctx->sbox_pool, ctx->seq_buffer, ciphertext, plaintext, length);
+// Decrypts the blocks at start with their masks, subtracting the masks afterwards. Blocks are
+// consecutive words from start, as a batch when there are several.
+static int
+decrypt_blocks(const fast_context_t *ctx, const layer_program_t *prog, uint8_t *start,
+               const uint8_t *masks, size_t blocks)
+{
+    const size_t ell    = ctx->params.word_length;
+    const int    status = blocks == 1
+                              ? fast_cdec(ctx->dec_kernel, &ctx->params, prog, start, start, ell)
+                              : fast_cdec_batch(ctx->dec_batch_kernel, &ctx->params, prog, start,
+                                                start, ell, blocks);
+    if (status != 0) {
+        return -1;
+    }
+    for (size_t j = 0; j < blocks * ell; j++) {
+        start[j] = mod_sub(start[j], masks[j], ctx->params.radix);
+    }
     return 0;
 }
+
+int
+fast_encrypt_long(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                  const uint8_t *plaintext, uint8_t *ciphertext, size_t length)
+{
+    if (check_long_args(ctx, tweak, tweak_len, plaintext, ciphertext, length) != 0) {
+        return -1;
+    }
+
+    if (ensure_direction(ctx, false) != 0) {
+        return -1;
+    }
+
+    if (ensure_sequence(ctx, true, tweak, tweak_len) != 0) {
+        return -1;
+    }
+
+    const layer_program_t *prog   = local_program(ctx);
+    const size_t           ell    = ctx->params.word_length;
+    const size_t           size   = long_buffer_size(ell, 1);
+    uint8_t               *buffer = malloc(size);
+    int                    status = -1;
+    if (!buffer) {
+        return -1;
+    }
+
+    if (ciphertext != plaintext) {
+        memcpy(ciphertext, plaintext, length);
+    }
+
+    if (long_ivs(ctx, tweak, tweak_len, length, buffer) == 0 &&
+        encrypt_pass(ctx, prog, ciphertext, length, buffer, buffer + 2 * ell, false) == 0 &&
+        encrypt_pass(ctx, prog, ciphertext, length, buffer + ell, buffer + 2 * ell, true) == 0) {
+        status = 0;
+    }
+
+    memset(buffer, 0, size);
+    free(buffer);
+    return status;
+}
+
+int
+fast_decrypt_long(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                  const uint8_t *ciphertext, uint8_t *plaintext, size_t length)
+{
+    if (check_long_args(ctx, tweak, tweak_len, ciphertext, plaintext, length) != 0) {
+        return -1;
+    }
+
+    if (ensure_direction(ctx, true) != 0) {
+        return -1;
+    }
+
+    if (ensure_sequence(ctx, true, tweak, tweak_len) != 0) {
+        return -1;
+    }
+
+    const layer_program_t *prog   = local_program(ctx);
+    const size_t           ell    = ctx->params.word_length;
+    const size_t           count  = (length + ell - 1) / ell;
+    const size_t           last   = length - ell;
+    const uint32_t         radix  = ctx->params.radix;
+    const size_t           size   = long_buffer_size(ell, count);
+    uint8_t               *buffer = malloc(size);
+    const uint8_t         *iv1    = buffer;
+    const uint8_t         *iv2    = buffer + ell;
+    uint8_t               *masks  = buffer + 2 * ell;
+    if (!buffer) {
+        return -1;
+    }
+    if (long_ivs(ctx, tweak, tweak_len, length, buffer) != 0) {
+        free(buffer);
+        return -1;
+    }
+
+    if (plaintext != ciphertext) {
+        memcpy(plaintext, ciphertext, length);
+    }
+
+    // Backward pass: blocks before the last one are disjoint, and each chain is the final
+    // ciphertext after its block, so they go first, as a batch. That restores the part of the
+    // last block the one before it overlapped, and the last block, chained to nothing, follows.
+    int status = 0;
+    for (size_t i = 0; i + 1 < count; i++) {
+        mask_after(plaintext, length, i * ell, ell, radix, iv2, masks + i * ell);
+    }
+    if (count > 1) {
+        status = decrypt_blocks(ctx, prog, plaintext, masks, count - 1);
+    }
+    if (status == 0) {
+        mask_after(plaintext, length, last, ell, radix, iv2, masks);
+        status = decrypt_blocks(ctx, prog, plaintext + last, masks, 1);
+    }
+
+    // Forward pass: the last block first, as it does not overlap its own chain. All the other
+    // blocks then hold their ciphertext, and so do their chains.
+    if (status == 0) {
+        mask_before(plaintext, last, ell, radix, iv1, masks);
+        status = decrypt_blocks(ctx, prog, plaintext + last, masks, 1);
+    }
+    if (status == 0 && count > 1) {
+        for (size_t i = 0; i + 1 < count; i++) {
+            mask_before(plaintext, i * ell, ell, radix, iv1, masks + i * ell);
+        }
+        status = decrypt_blocks(ctx, prog, plaintext, masks, count - 1);
+    }
+
+    memset(buffer, 0, size);
+    free(buffer);
+    return status;
+}
@@ -6,8 +6,10 @@
 #include <stdint.h>
 
 // Public constants
-#define FAST_MAX_RADIX      256
+#define FAST_MAX_RADIX      256 // Largest radix of uint8_t symbols
+#define FAST_MAX_RADIX16    65536 // Largest radix of uint16_t symbols (fast_encrypt16)
 #define FAST_SBOX_POOL_SIZE 256
+#define FAST_MAX_SBOX_COUNT 65536 // Largest S-box pool (sbox_count)
 #define FAST_AES_BLOCK_SIZE 16
 #define FAST_AES_KEY_SIZE   16
 
@@ -15,7 +17,7 @@
 typedef struct {
     uint32_t radix; // a: radix (must be >= 4)
     uint32_t word_length; // ℓ: length of plaintext/ciphertext words
-    uint32_t sbox_count; // m: number of S-boxes in pool (typically 256)
+    uint32_t sbox_count; // m: number of S-boxes in pool (typically 256, at most 65536)
     uint32_t num_layers; // n: number of SPN layers
     uint32_t branch_dist1; // w: branch distance for first part
     uint32_t branch_dist2; // w': branch distance for second part
@@ -25,6 +27,15 @@ typedef struct {
 // Opaque context structure for public API
 typedef struct fast_context fast_context_t;
 
+// CPU tiers, each one adding vector kernels to those of the tiers below it
+typedef enum {
+    FAST_CPU_TIER_AUTO   = -1, // Best tier of the running CPU
+    FAST_CPU_TIER_SCALAR = 0, // Portable C kernels only
+    FAST_CPU_TIER_SSSE3  = 1, // 16-lane shuffle kernels (x86 SSSE3)
+    FAST_CPU_TIER_AVX2   = 2, // 32-lane shuffle kernels (x86 AVX2)
+    FAST_CPU_TIER_AVX512 = 3, // 64-lane permute kernels (x86 AVX-512 BW and VBMI)
+} fast_cpu_tier_t;
+
 // Public API functions
 
 /**
@@ -41,12 +52,177 @@ typedef struct fast_context fast_context_t;
  */
 int fast_init(fast_context_t **ctx, const fast_params_t *params, const uint8_t *key);
 
+// fast_init_ex() flags
+#define FAST_INIT_JIT           (1U << 0) // Compile each tweak's layer sequence to machine code
+#define FAST_INIT_AUTOTUNE      (1U << 1) // Time the candidate kernels and bind the fastest
+#define FAST_INIT_ENCRYPT_ONLY  (1U << 2) // Only build and allow the encryption direction
+#define FAST_INIT_DECRYPT_ONLY  (1U << 3) // Only build and allow the decryption direction
+#define FAST_INIT_HUGE_PAGES    (1U << 4) // Back the context's memory with 2 MiB pages
+#define FAST_INIT_NUMA_REPLICAS (1U << 5) // Keep a read-only S-box pool on every NUMA node
+
+/**
+ * Initialize a FAST cipher context with options
+ *
+ * Same as fast_init(), with a combination of FAST_INIT_* flags:
+ *
+ * - FAST_INIT_JIT: whenever the tweak changes, single-word encryption and
+ *   decryption are compiled into straight-line machine code for the new
+ *   layer sequence. This costs some time and memory per tweak change and
+ *   pays off when each tweak is used for many words. It is ignored where no
+ *   JIT is available (non-x86-64, or more than 4096 layers), and if code
+ *   generation fails the regular kernels are used.
+ *
+ * - FAST_INIT_AUTOTUNE: instead of taking the first suitable kernel in order
+ *   of preference, each entry point (single word and batch, encryption and
+ *   decryption) gets the fastest one on this host for these parameters, as
+ *   measured in about 20 ms of micro-benchmarks. With FAST_INIT_JIT, the JIT
+ *   is one of the candidates rather than forced. If FAST_TUNE_CACHE names a
+ *   file, choices are looked up there first, keyed by CPU model, parameters,
+ *   CPU tier, JIT flag and directions, and new ones are appended to it.
+ *
+ * - FAST_INIT_ENCRYPT_ONLY, FAST_INIT_DECRYPT_ONLY: the context only holds
+ *   the S-box tables of one direction, half of the pool, and every call in
+ *   the other direction fails. Without either flag, a context builds its
+ *   inverse tables on its first decryption (at init with
+ *   FAST_INIT_AUTOTUNE), so encryption-only use never pays for them.
+ *
+ * - FAST_INIT_HUGE_PAGES: the context, its layer sequence and its S-box
+ *   pool are placed in 2 MiB pages, from the hugetlb pool when pages are
+ *   reserved there and as transparent huge pages otherwise, so that table
+ *   lookups do not miss the TLB. Each context takes at least one huge page.
+ *
+ * - FAST_INIT_NUMA_REPLICAS: on a host with several NUMA nodes, the S-box
+ *   pool is copied into memory on each node and made read-only, and every
+ *   call reads the copy of the node the calling thread runs on. This
+ *   multiplies the pool memory by the number of nodes, and the JIT
+ *   (FAST_INIT_JIT) compiles each tweak once per node. It changes nothing
+ *   on a single node; contexts still must not be used from several threads
+ *   at once. The node topology is read once, on first use, safely from any
+ *   thread. fast_numa_simulate(), an internal hook that fakes a topology,
+ *   is for tests only and must not run while other threads use the library.
+ *
+ * @param ctx    Pointer to context pointer (will be allocated)
+ * @param params Cipher parameters including radix, word length, and security settings
+ * @param key    Master key of FAST_AES_KEY_SIZE (16) bytes
+ * @param flags  Bitwise OR of FAST_INIT_* flags, or 0
+ * @return       0 on success, -1 on error (invalid parameters or flags, both direction flags,
+ *               allocation failure)
+ */
+int fast_init_ex(fast_context_t **ctx, const fast_params_t *params, const uint8_t *key,
+                 uint32_t flags);
+
+/**
+ * Size of the memory fast_init_into() needs for a context
+ *
+ * Covers everything the context holds for these parameters and flags: the
+ * S-box pool (including the inverse tables a two-way context builds on its
+ * first decryption), the layer sequence and program, the tweak cache and the
+ * context itself, plus slack to align a buffer of any alignment.
+ *
+ * @param params Cipher parameters the context will be created with
+ * @param flags  FAST_INIT_* flags it will be created with
+ * @return       Size in bytes, or 0 if fast_init_into() would reject the parameters or flags
+ */
+size_t fast_context_size(const fast_params_t *params, uint32_t flags);
+
+/**
+ * Initialize a FAST cipher context in caller-provided memory
+ *
+ * Same as fast_init_ex(), but the context and all of its data are laid out
+ * contiguously in buffer, which the context uses until fast_cleanup(). The
+ * only exceptions are the OpenSSL cipher context holding the expanded key,
+ * and JIT code (FAST_INIT_JIT), which lives in its own executable pages.
+ * fast_cleanup() must still be called; it wipes the key and releases JIT
+ * code, but leaves the buffer to the caller. The caller chooses where the
+ * buffer lives, so FAST_INIT_HUGE_PAGES and FAST_INIT_NUMA_REPLICAS are
+ * rejected.
+ *
+ * @param ctx    Pointer to context pointer (will point into buffer)
+ * @param buffer Memory for the context, of any alignment
+ * @param size   Size of buffer, at least fast_context_size(params, flags)
+ * @param params Cipher parameters including radix, word length, and security settings
+ * @param key    Master key of FAST_AES_KEY_SIZE (16) bytes
+ * @param flags  Bitwise OR of FAST_INIT_* flags, or 0
+ * @return       0 on success, -1 on error (invalid parameters or flags, buffer too small)
+ */
+int fast_init_into(fast_context_t **ctx, void *buffer, size_t size, const fast_params_t *params,
+                   const uint8_t *key, uint32_t flags);
+
+/**
+ * Encrypt a message of any length from one word up
+ *
+ * Long-message mode: the message is split into blocks of the context's word
+ * length, the last one overlapping the one before it if needed. Blocks are
+ * encrypted in two chained passes, each block being encrypted as a word
+ * after adding an IV derived from the key, the tweak and the message length
+ * and the ciphertext symbols next to it: those before it in a first, forward
+ * pass, and those after it in a second, backward one. The cost is linear in
+ * the length, at twice the per-symbol cost of the word length, instead of
+ * that of the very long words calculate_recommended_params() gives for the
+ * whole message.
+ *
+ * A change anywhere in the plaintext changes every block of the ciphertext,
+ * so messages sharing a prefix or some blocks do not share ciphertext
+ * blocks. What remains visible is whole-message equality: the mode is
+ * deterministic, and equal messages of the same length under the same tweak
+ * give equal ciphertexts, as with fast_encrypt(). The two passes are a
+ * chaining construction over the word cipher, not a proven wide-block
+ * cipher.
+ *
+ * Blocks are encrypted one after the other, as each pass chains them;
+ * decryption runs each pass as a batch. The result differs from
+ * fast_encrypt() even for a single-block message.
+ *
+ * @param ctx        Initialized FAST context
+ * @param tweak      Tweak bytes (can be NULL if tweak_len is 0)
+ * @param tweak_len  Length of tweak in bytes
+ * @param plaintext  Input message, symbols in [0, radix-1]
+ * @param ciphertext Output buffer, may be the same as plaintext
+ * @param length     Message length, at least word_length (and below 2^32)
+ * @return           0 on success, -1 on error
+ */
+int fast_encrypt_long(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                      const uint8_t *plaintext, uint8_t *ciphertext, size_t length);
+
+/**
+ * Decrypt a message encrypted with fast_encrypt_long()
+ *
+ * @param ctx        Initialized FAST context
+ * @param tweak      Tweak bytes (can be NULL if tweak_len is 0)
+ * @param tweak_len  Length of tweak in bytes
+ * @param ciphertext Input message, symbols in [0, radix-1]
+ * @param plaintext  Output buffer, may be the same as ciphertext
+ * @param length     Message length, at least word_length (and below 2^32)
+ * @return           0 on success, -1 on error
+ */
+int fast_decrypt_long(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                      const uint8_t *ciphertext, uint8_t *plaintext, size_t length);
+
+// Kernels bound to a context
+typedef struct {
+    const char *encrypt; // fast_encrypt()
+    const char *decrypt; // fast_decrypt()
+    const char *encrypt_batch; // fast_encrypt_batch()
+    const char *decrypt_batch; // fast_decrypt_batch()
+    bool        autotuned; // Chosen by FAST_INIT_AUTOTUNE, measured or from the cache
+} fast_kernel_info_t;
+
+/**
+ * Get the names of the kernels a context runs
+ *
+ * @param ctx  Initialized context
+ * @param info Output structure; the names are static strings
+ * @return     0 on success, -1 on error (NULL argument)
+ */
+int fast_get_kernel_info(const fast_context_t *ctx, fast_kernel_info_t *info);
+
 /**
  * Clean up and free a FAST cipher context
  *
  * Releases all resources associated with the context including S-box pools,
  * cached tweaks, and internal buffers. The context pointer becomes invalid
- * after this call.
+ * after this call. For a context created with fast_init_into(), the buffer is
+ * left to the caller and can be reused once this returns.
  *
  * @param ctx Context to clean up (can be NULL)
  */
@@ -57,7 +233,8 @@ void fast_cleanup(fast_context_t *ctx);
  *
  * Performs format-preserving encryption on the input plaintext using the
  * initialized context and optional tweak. The plaintext and ciphertext
- * must be arrays of bytes in the range [0, radix-1].
+ * must be arrays of bytes in the range [0, radix-1]. Contexts with a radix
+ * above FAST_MAX_RADIX use fast_encrypt16() instead.
  *
  * @param ctx        Initialized FAST context
  * @param tweak      Optional domain separation tweak (can be NULL)
@@ -88,6 +265,119 @@ int fast_encrypt(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
 int fast_decrypt(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
                  const uint8_t *ciphertext, uint8_t *plaintext, size_t length);
 
+/**
+ * Encrypt a batch of words using the FAST cipher
+ *
+ * Encrypts count words of length symbols each, stored back to back, under a
+ * single tweak. The output is identical to calling fast_encrypt() on every
+ * word, but several words are pushed through each layer together so that
+ * their independent table lookups overlap. The input and output buffers may
+ * be the same.
+ *
+ * @param ctx         Initialized FAST context
+ * @param tweak       Optional domain separation tweak shared by all words (can be NULL)
+ * @param tweak_len   Length of tweak in bytes (0 if tweak is NULL)
+ * @param plaintexts  count * length input symbols (values must be < radix)
+ * @param ciphertexts Output array of count * length symbols
+ * @param length      Length of each word (must be the context's word length)
+ * @param count       Number of words
+ * @return           0 on success, -1 on error (invalid parameters or values); on
+ *                   error no word has been encrypted
+ */
+int fast_encrypt_batch(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                       const uint8_t *plaintexts, uint8_t *ciphertexts, size_t length,
+                       size_t count);
+
+/**
+ * Decrypt a batch of words using the FAST cipher
+ *
+ * Decrypts count words of length symbols each, stored back to back, under a
+ * single tweak. The output is identical to calling fast_decrypt() on every
+ * word. The input and output buffers may be the same.
+ *
+ * @param ctx         Initialized FAST context
+ * @param tweak       Optional domain separation tweak (must match encryption tweak)
+ * @param tweak_len   Length of tweak in bytes (0 if tweak is NULL)
+ * @param ciphertexts count * length input symbols (values must be < radix)
+ * @param plaintexts  Output array of count * length symbols
+ * @param length      Length of each word (must be the context's word length)
+ * @param count       Number of words
+ * @return           0 on success, -1 on error (invalid parameters or values); on
+ *                   error no word has been decrypted
+ */
+int fast_decrypt_batch(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                       const uint8_t *ciphertexts, uint8_t *plaintexts, size_t length,
+                       size_t count);
+
+/**
+ * Encrypt a word of 16-bit symbols using the FAST cipher
+ *
+ * Same as fast_encrypt(), for contexts with a radix above FAST_MAX_RADIX
+ * (up to FAST_MAX_RADIX16), whose symbols do not fit in a byte. Such
+ * contexts only accept these two functions.
+ *
+ * @param ctx        Initialized FAST context with a radix above FAST_MAX_RADIX
+ * @param tweak      Optional domain separation tweak (can be NULL)
+ * @param tweak_len  Length of tweak in bytes (0 if tweak is NULL)
+ * @param plaintext  Input plaintext array (values must be < radix)
+ * @param ciphertext Output ciphertext array (may be the same as plaintext)
+ * @param length     Length of plaintext/ciphertext arrays in symbols
+ * @return          0 on success, -1 on error (invalid parameters or values,
+ *                  or a radix of at most FAST_MAX_RADIX)
+ */
+int fast_encrypt16(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                   const uint16_t *plaintext, uint16_t *ciphertext, size_t length);
+
+/**
+ * Decrypt a word of 16-bit symbols using the FAST cipher
+ *
+ * Same as fast_decrypt(), for contexts with a radix above FAST_MAX_RADIX.
+ *
+ * @param ctx        Initialized FAST context with a radix above FAST_MAX_RADIX
+ * @param tweak      Optional domain separation tweak (must match encryption tweak)
+ * @param tweak_len  Length of tweak in bytes (0 if tweak is NULL)
+ * @param ciphertext Input ciphertext array (values must be < radix)
+ * @param plaintext  Output plaintext array (may be the same as ciphertext)
+ * @param length     Length of ciphertext/plaintext arrays in symbols
+ * @return          0 on success, -1 on error (invalid parameters or values,
+ *                  or a radix of at most FAST_MAX_RADIX)
+ */
+int fast_decrypt16(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
+                   const uint16_t *ciphertext, uint16_t *plaintext, size_t length);
+
+/**
+ * Get the CPU tier new contexts bind their kernels for
+ *
+ * The running CPU is probed once, on first use from whichever thread, and
+ * every thread sees the result of that probe. The tier returned is the
+ * best one it supports, unless lowered by fast_set_cpu_tier() or, failing
+ * that, by the FAST_CPU_TIER environment variable ("scalar", "ssse3",
+ * "avx2" or "avx512"), which is read at the same time as the CPU is probed.
+ *
+ * @return The tier in effect, never above what the CPU supports
+ */
+fast_cpu_tier_t fast_cpu_tier(void);
+
+/**
+ * Force the CPU tier used by contexts created from now on
+ *
+ * Meant for debugging and testing: existing contexts keep their kernels.
+ * Must not be called concurrently with fast_init().
+ *
+ * @param tier Tier to use, or FAST_CPU_TIER_AUTO to go back to the detected
+ *             tier (or the one set in the environment)
+ * @return     0 on success, -1 if the CPU does not support the tier
+ */
+int fast_set_cpu_tier(fast_cpu_tier_t tier);
+
+/**
+ * Get the name of a CPU tier, as accepted in FAST_CPU_TIER
+ *
+ * @param tier CPU tier
+ * @return     Static string, "auto" for FAST_CPU_TIER_AUTO, NULL if unknown
+ */
+const char *fast_cpu_tier_name(fast_cpu_tier_t tier);
+
 /**
  * Calculate recommended parameters for FAST cipher
  *
@@ -96,7 +386,7 @@ int fast_decrypt(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len,
  * tables with logarithmic interpolation for radix values not in the table.
  *
  * @param params      Output parameter structure to fill
- * @param radix       Desired radix (base) for the cipher, must be in [4, 256]
+ * @param radix       Desired radix (base) for the cipher, must be in [4, 65536]
  * @param word_length Length of words to encrypt/decrypt
  * @return           0 on success, -1 on error (invalid radix or word length)
  */
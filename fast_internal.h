@@ -10,61 +10,457 @@
 #define FAST_MASTER_KEY_SIZE  FAST_AES_KEY_SIZE
 #define FAST_DERIVED_KEY_SIZE 32U
 
+// Fused tables: for radices up to FAST_FUSED_MAX_RADIX, a layer's modular addition or subtraction
+// and the S-box lookup that follows it collapse into a single lookup in a 2D table with one
+// (1 << FAST_FUSED_SHIFT)-byte row per symbol, indexed by (x << FAST_FUSED_SHIFT) | y
+#define FAST_FUSED_MAX_RADIX 16U
+#define FAST_FUSED_SHIFT     4U
+// Forward fused tables are only worth it while the whole set stays L1-resident
+#define FAST_FUSED_ENC_BUDGET (48U * 1024U)
+
+// Padded tables: each S-box and its inverse, zero-filled up to a power-of-two stride so that
+// vector kernels can load them as shuffle or permute tables. For radices up to
+// FAST_PADDED_MAX_RADIX, with a stride of at least FAST_PADDED_MIN_STRIDE bytes, this is the
+// layout of the pool slab itself
+#define FAST_PADDED_MAX_RADIX  128U
+#define FAST_PADDED_MIN_STRIDE 16U
+
+// Alignment of the pool slab; its tables are rounded up to whole lines past this size
+#define FAST_CACHE_LINE 64U
+
+// Longest tweak a context keeps in its sequence cache; longer tweaks derive their sequence anew on
+// every call
+#define FAST_TWEAK_CACHE_SIZE 256U
+
+// Most NUMA nodes a context keeps S-box pool replicas on, and highest node id it binds them to
+#define FAST_MAX_NUMA_NODES 64U
+
+// Huge pages FAST_INIT_HUGE_PAGES asks for, the x86-64 and arm64 PMD size
+#define FAST_HUGE_PAGE_SIZE (2U * 1024U * 1024U)
+
+// Longest word the vector kernels keep in their on-stack transposed buffer
+#define FAST_VECTOR_MAX_LENGTH 256U
+
+// Longest layer sequence the JIT compiles, bounding its code to a few hundred KiB per tweak
+#define FAST_JIT_MAX_LAYERS 4096U
+
+// x86 vector kernels use per-function target attributes, so they need GCC or clang but no special
+// compiler flags. They are only selected when the running CPU has the instructions they use.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#    define FAST_X86_KERNELS 1
+#endif
+
 // Internal data structures
 
+// Bump allocator over one caller-supplied region, for contexts created with fast_init_into().
+// Every block starts on a cache line and takes whole lines, so the size a layout needs is the sum
+// of arena_bytes() over its blocks, whatever their order.
 typedef struct {
-    uint8_t *perm; // Permutation array of size radix
-    uint8_t *inv; // Inverse permutation for fast lookup
-    uint32_t radix; // Size of the permutation
+    uint8_t *base; // Start of the region, on a cache line
+    size_t   size; // Bytes in the region
+    size_t   used; // Bytes handed out so far
+} fast_arena_t;
+
+static inline size_t
+arena_bytes(size_t bytes)
+{
+    return (bytes + FAST_CACHE_LINE - 1) & ~(size_t) (FAST_CACHE_LINE - 1);
+}
+
+// Next block of the region, or NULL once it is exhausted. Blocks are not zeroed.
+static inline void *
+arena_alloc(fast_arena_t *arena, size_t bytes)
+{
+    const size_t need = arena_bytes(bytes);
+    if (need > arena->size - arena->used) {
+        return NULL;
+    }
+    void *block = arena->base + arena->used;
+    arena->used += need;
+    return block;
+}
+
+// Radices up to FAST_MAX_RADIX use perm / inv, wider ones perm16 / inv16; the others are NULL.
+// The S-boxes of a pool point into its slabs, and only have the directions the pool has built.
+typedef struct {
+    uint8_t  *perm; // Permutation array of size radix
+    uint8_t  *inv; // Inverse permutation for fast lookup
+    uint16_t *perm16; // Permutation of a wide S-box
+    uint16_t *inv16; // Inverse permutation of a wide S-box
+    uint32_t  radix; // Size of the permutation
 } sbox_t;
 
+// Fused table layout for S-box i, with T = radix << FAST_FUSED_SHIFT bytes per table:
+//   fused_enc + 2 * i * T: perm[(x + y) mod a] << FAST_FUSED_SHIFT, i.e. already the row offset
+//                          into the next table, followed by perm[(x - y) mod a]
+//   fused_dec + i * T:     inv[(x + y) mod a]
+// Single lookups are the y = 0 column: perm[x] and inv[x] sit at x << FAST_FUSED_SHIFT in the
+// subtraction and inverse tables.
+//
+// Slab layout for S-box i, with S = sbox_stride, one FAST_CACHE_LINE-aligned allocation per
+// direction, so that a context only keeps the direction it runs resident:
+//   perm_slab + i * S: perm, zero-filled to S bytes
+//   inv_slab + i * S:  inv, zero-filled to S bytes
+// Entries are uint8_t, or uint16_t above FAST_MAX_RADIX. S is the next power of two of the table
+// size up to a cache line, at least FAST_PADDED_MIN_STRIDE, so that S-boxes of small radices
+// share lines without straddling them (four per line up to radix 16), then whole cache lines.
+// Up to FAST_PADDED_MAX_RADIX, S is padded_stride() and the slabs are the padded tables.
+//
+// A pool is generated with either direction or both (FAST_SBOX_FORWARD / FAST_SBOX_INVERSE);
+// inverse tables can be derived later from the forward ones with build_inverse_tables(). A pool
+// generated in an arena takes all of its memory from it, including the inverse tables built
+// later, and frees none of it.
 typedef struct {
-    sbox_t  *sboxes; // Array of S-boxes
-    uint32_t count; // Number of S-boxes
-    uint32_t radix; // Radix for all S-boxes
+    sbox_t       *sboxes; // Array of S-boxes
+    uint32_t      count; // Number of S-boxes
+    uint32_t      radix; // Radix for all S-boxes
+    uint8_t      *perm_slab; // perm tables of every S-box, or NULL
+    uint8_t      *inv_slab; // inv tables of every S-box, or NULL
+    size_t        sbox_stride; // Bytes per table in the slabs
+    uint8_t      *fused_enc; // Fused forward tables, or NULL
+    uint8_t      *fused_dec; // Fused inverse tables, or NULL
+    bool          padded; // Slabs have the padded layout
+    fast_arena_t *arena; // Region holding the pool's memory, or NULL for the heap
 } sbox_pool_t;
 
+// Directions generate_sbox_pool() builds
+#define FAST_SBOX_FORWARD 1U
+#define FAST_SBOX_INVERSE 2U
+
+// S-box table families a layer program can point at
+typedef enum {
+    FAST_TABLES_PLAIN, // perm / inv arrays of each sbox_t
+    FAST_TABLES_FUSED, // Fused tables of the pool
+    FAST_TABLES_PADDED, // Padded tables of the pool
+    FAST_TABLES_WIDE, // perm16 / inv16 arrays of each sbox_t, as byte pointers
+    FAST_TABLES_COUNT
+} fast_tables_t;
+
+// Layer program: the S-box of each layer as a compact index, and per direction and table family
+// the table of S-box 0 and the distance between the tables of consecutive S-boxes, so that the word
+// engine is a plain table walk: layer i reads enc[f] + sbox * enc_stride[f]. The program points at
+// the layer sequence rather than copying it, so it holds one byte per layer (seq8) for pools of up
+// to 256 S-boxes and two (seq16) above. Families the pool lacks stay NULL, as do both directions
+// until the pool has built them.
 typedef struct {
-    EVP_CIPHER_CTX *ctx; // Reusable AES-128-ECB context for the PRNG
-    uint8_t         counter[FAST_AES_BLOCK_SIZE];
-    uint8_t         buffer[FAST_AES_BLOCK_SIZE];
-    size_t          buffer_pos;
+    const uint8_t  *seq8; // S-box of each layer, in layer order, or NULL
+    const uint16_t *seq16; // Same, for pools of more than 256 S-boxes
+    const uint8_t  *enc[FAST_TABLES_COUNT]; // Forward table of S-box 0 per family, or NULL
+    const uint8_t  *dec[FAST_TABLES_COUNT]; // Inverse table of S-box 0 per family, or NULL
+    size_t          enc_stride[FAST_TABLES_COUNT]; // Bytes from one forward table to the next
+    size_t          dec_stride[FAST_TABLES_COUNT]; // Bytes from one inverse table to the next
+    uint32_t        num_layers; // Number of compiled layers
+    bool            forward; // enc tables are set
+    bool            inverse; // dec tables are set
+    void (*jit_enc)(uint8_t *data); // JIT-compiled forward program, or NULL
+    void (*jit_dec)(uint8_t *data); // JIT-compiled inverse program, or NULL
+    void  *jit_code; // Executable mapping holding both
+    size_t jit_size; // Size of that mapping
+} layer_program_t;
+
+// Bytes per layer of a sequence over a pool of sbox_count S-boxes
+static inline size_t
+seq_entry_size(uint32_t sbox_count)
+{
+    return sbox_count <= 256 ? sizeof(uint8_t) : sizeof(uint16_t);
+}
+
+// S-box of layer i
+static inline uint32_t
+layer_sbox(const layer_program_t *prog, uint32_t i)
+{
+    return prog->seq8 ? prog->seq8[i] : prog->seq16[i];
+}
+
+// Table of layer i in a family, given its base and stride in the program
+static inline const uint8_t *
+layer_table(const layer_program_t *prog, const uint8_t *base, size_t stride, uint32_t i)
+{
+    return base + (size_t) layer_sbox(prog, i) * stride;
+}
+
+// Word kernels: run a whole compiled layer program over one word in place, in one direction. Wide
+// kernels get a word of uint16_t symbols through the byte pointer.
+typedef void (*fast_word_fn)(const fast_params_t *params, const layer_program_t *prog,
+                             uint8_t *data);
+
+// Batch kernels: same, over count words stored back to back
+typedef void (*fast_batch_fn)(const fast_params_t *params, const layer_program_t *prog,
+                              uint8_t *data, size_t count);
+
+// A kernel provides a word function, a batch function, or both; the missing one is NULL
+typedef struct {
+    const char     *name;
+    fast_tables_t   tables; // Table family the layer program must point at
+    fast_cpu_tier_t tier; // Lowest CPU tier with the instructions the kernel uses
+    bool (*supports)(const fast_params_t *params, const sbox_pool_t *pool);
+    fast_word_fn  run;
+    fast_batch_fn batch;
+} fast_kernel_t;
+
+// Keystream the PRNG generates at a time: a single AES-CTR call over many blocks lets OpenSSL
+// pipeline them, instead of paying a call per block
+#define FAST_PRNG_BUFFER_SIZE 4096U
+// Bounded draws callers take at a time from prng_uniform_batch()
+#define FAST_PRNG_DRAWS 256U
+
+// AES-128-CTR keystream, whose first block encrypts the nonce plus one
+typedef struct {
+    EVP_CIPHER_CTX *ctx; // AES-128-CTR context, at the counter of the next refill
+    uint8_t         buffer[FAST_PRNG_BUFFER_SIZE]; // Keystream generated ahead
+    size_t          buffer_pos; // Bytes of it already used
 } prng_state_t;
 
+// CMAC-AES-128 key: the expanded AES key and the two CMAC subkeys
+typedef struct {
+    EVP_CIPHER_CTX *aes; // AES-128-ECB under the key
+    uint8_t         k1[FAST_AES_BLOCK_SIZE]; // Subkey of messages ending on a whole block
+    uint8_t         k2[FAST_AES_BLOCK_SIZE]; // Subkey of messages ending on a padded block
+} prf_t;
+
+// CMAC in progress: the chaining value, and the last block seen, held back until the end
+typedef struct {
+    uint8_t chain[FAST_AES_BLOCK_SIZE];
+    uint8_t pending[FAST_AES_BLOCK_SIZE];
+    size_t  pending_len;
+} cmac_state_t;
+
+// One input of the PRF, encoded as its 32-bit big-endian length followed by its bytes
+typedef struct {
+    const uint8_t *data;
+    size_t         len;
+} prf_part_t;
+
+static inline void
+write_u32_be(uint32_t value, uint8_t out[4])
+{
+    out[0] = (uint8_t) ((value >> 24) & 0xFF);
+    out[1] = (uint8_t) ((value >> 16) & 0xFF);
+    out[2] = (uint8_t) ((value >> 8) & 0xFF);
+    out[3] = (uint8_t) (value & 0xFF);
+}
+
+static inline uint32_t
+read_u32_be(const uint8_t in[4])
+{
+    return ((uint32_t) in[0] << 24) | ((uint32_t) in[1] << 16) | ((uint32_t) in[2] << 8) |
+           (uint32_t) in[3];
+}
+
+// Modular arithmetic on symbols
+//
+// Operands are always symbols already reduced below the radix, so a single conditional correction
+// gives the same result as a division by the radix.
+
+static inline uint8_t
+mod_add(uint32_t a, uint32_t b, uint32_t radix)
+{
+    uint32_t sum = a + b;
+    return (uint8_t) (sum >= radix ? sum - radix : sum);
+}
+
+static inline uint8_t
+mod_sub(uint32_t a, uint32_t b, uint32_t radix)
+{
+    return (uint8_t) (a >= b ? a - b : a + radix - b);
+}
+
+static inline uint16_t
+mod_add16(uint32_t a, uint32_t b, uint32_t radix)
+{
+    uint32_t sum = a + b;
+    return (uint16_t) (sum >= radix ? sum - radix : sum);
+}
+
+static inline uint16_t
+mod_sub16(uint32_t a, uint32_t b, uint32_t radix)
+{
+    return (uint16_t) (a >= b ? a - b : a + radix - b);
+}
+
+// Stride of the padded tables for a radix: the next power of two, at least FAST_PADDED_MIN_STRIDE
+static inline uint32_t
+padded_stride(uint32_t radix)
+{
+    uint32_t stride = FAST_PADDED_MIN_STRIDE;
+    while (stride < radix) {
+        stride <<= 1;
+    }
+    return stride;
+}
+
+// Stride of the slab tables for a radix (see sbox_pool_t)
+static inline size_t
+sbox_stride(uint32_t radix)
+{
+    const size_t bytes = (size_t) radix * (radix > FAST_MAX_RADIX ? sizeof(uint16_t) : 1U);
+    if (bytes <= FAST_CACHE_LINE) {
+        return padded_stride(radix);
+    }
+    return (bytes + FAST_CACHE_LINE - 1) / FAST_CACHE_LINE * FAST_CACHE_LINE;
+}
+
+// Forward or inverse table of S-box i, for a direction the pool has built
+static inline const uint8_t *
+pool_table(const sbox_pool_t *pool, uint32_t i, bool inverse)
+{
+    return (inverse ? pool->inv_slab : pool->perm_slab) + (size_t) i * pool->sbox_stride;
+}
+
+static inline uint8_t
+add_mod256(uint8_t a, uint8_t b)
+{
+    return (uint8_t) (a + b);
+}
+
+static inline uint8_t
+sub_mod256(uint8_t a, uint8_t b)
+{
+    return (uint8_t) (a - b);
+}
+
 // S-box functions
-int  generate_sbox(sbox_t *sbox, uint32_t radix, prng_state_t *prng);
-int  generate_sbox_pool(sbox_pool_t *pool, uint32_t count, uint32_t radix, prng_state_t *prng);
-void free_sbox_pool(sbox_pool_t *pool);
-void apply_sbox(const sbox_t *sbox, uint8_t *data);
-void apply_inverse_sbox(const sbox_t *sbox, uint8_t *data);
+int    generate_sbox(sbox_t *sbox, uint32_t radix, prng_state_t *prng);
+int    generate_sbox_pool(sbox_pool_t *pool, uint32_t count, uint32_t radix, prng_state_t *prng,
+                          uint32_t directions, fast_arena_t *arena);
+int    build_inverse_tables(sbox_pool_t *pool);
+int    copy_sbox_pool(sbox_pool_t *dst, const sbox_pool_t *src, fast_arena_t *arena);
+size_t sbox_pool_size(uint32_t count, uint32_t radix, uint32_t directions);
+void   free_sbox_pool(sbox_pool_t *pool);
+void   apply_sbox(const sbox_t *sbox, uint8_t *data);
+void   apply_inverse_sbox(const sbox_t *sbox, uint8_t *data);
 
 // Layer functions
 void fast_es_layer(const fast_params_t *params, const sbox_pool_t *pool, uint8_t *data,
                    size_t length, uint32_t sbox_index);
 void fast_ds_layer(const fast_params_t *params, const sbox_pool_t *pool, uint8_t *data,
                    size_t length, uint32_t sbox_index);
+void fast_es_layer16(const fast_params_t *params, const sbox_pool_t *pool, uint16_t *data,
+                     size_t length, uint32_t sbox_index);
+void fast_ds_layer16(const fast_params_t *params, const sbox_pool_t *pool, uint16_t *data,
+                     size_t length, uint32_t sbox_index);
 
 // Component encryption/decryption
-void fast_cenc(const fast_params_t *params, const sbox_pool_t *pool, const uint32_t *seq,
-               const uint8_t *input, uint8_t *output, size_t length);
-void fast_cdec(const fast_params_t *params, const sbox_pool_t *pool, const uint32_t *seq,
-               const uint8_t *input, uint8_t *output, size_t length);
+
+// Kernel registries, in order of preference and NULL-terminated
+extern const fast_kernel_t *const fast_encrypt_kernels[];
+extern const fast_kernel_t *const fast_decrypt_kernels[];
+
+#ifdef FAST_X86_KERNELS
+// Vector batch kernels (cenc_cdec_x86.c): byte permutes for radices up to 128, shuffles for
+// radices up to 16, and both for radix 256
+extern const fast_kernel_t fast_x86_encrypt_vbmi_256;
+extern const fast_kernel_t fast_x86_decrypt_vbmi_256;
+extern const fast_kernel_t fast_x86_encrypt_avx2_256;
+extern const fast_kernel_t fast_x86_decrypt_avx2_256;
+extern const fast_kernel_t fast_x86_encrypt_vbmi;
+extern const fast_kernel_t fast_x86_decrypt_vbmi;
+extern const fast_kernel_t fast_x86_encrypt_avx2;
+extern const fast_kernel_t fast_x86_decrypt_avx2;
+extern const fast_kernel_t fast_x86_encrypt_ssse3;
+extern const fast_kernel_t fast_x86_decrypt_ssse3;
+#endif
+
+// Per-tweak JIT (jit_x86_64.c). The JIT kernels run the program's compiled code, or the generic
+// loop when there is none; they are bound by FAST_INIT_JIT rather than through the registries.
+extern const fast_kernel_t fast_jit_encrypt_kernel;
+extern const fast_kernel_t fast_jit_decrypt_kernel;
+
+bool fast_jit_available(const fast_params_t *params);
+int  fast_jit_compile(layer_program_t *prog, const fast_params_t *params);
+void fast_jit_release(layer_program_t *prog);
+
+// Kernels bound to a context, one per entry point
+typedef struct {
+    const fast_kernel_t *enc;
+    const fast_kernel_t *dec;
+    const fast_kernel_t *enc_batch;
+    const fast_kernel_t *dec_batch;
+} fast_kernel_set_t;
+
+// Autotuner (tune.c): binds each entry point to the fastest eligible kernel, the JIT kernels
+// included when jit is set, going through the FAST_TUNE_CACHE file when there is one. Entry points
+// of a direction the pool has not built keep the kernels set holds on entry.
+int fast_autotune(fast_kernel_set_t *set, const fast_params_t *params, const sbox_pool_t *pool,
+                  fast_cpu_tier_t tier, bool jit);
+
+// CPU model name for the tuning cache (cpu.c): the x86 brand string, or "unknown"
+#define FAST_CPU_MODEL_SIZE 64U
+void fast_cpu_model(char *model, size_t size);
+
+// Memory placement (numa.c). Nodes are numbered by index from 0 to fast_numa_nodes() - 1, which is
+// 1 where NUMA is unknown. Mappings are rounded up to whole pages, huge ones to whole huge pages,
+// and *size is updated to the mapped size; node -1 leaves placement to the default policy.
+uint32_t fast_numa_nodes(void);
+uint32_t fast_numa_node(void); // Node the calling thread runs on
+void    *fast_pages_map(size_t *size, bool huge, int32_t node);
+void     fast_pages_unmap(void *pages, size_t size);
+int      fast_pages_protect(void *pages, size_t size, bool writable);
+// For testing only: pretend to have nodes nodes, the calling thread always running on current,
+// with memory of the nodes beyond the real ones left unbound; 0 goes back to the real topology.
+// The setting is unsynchronised, so no other thread may be using the library meanwhile.
+void fast_numa_simulate(uint32_t nodes, uint32_t current);
+
+// First kernel of a registry that runs on the CPU tier, supports the parameters and has a word
+// (resp. batch) function
+const fast_kernel_t *fast_select_kernel(const fast_kernel_t *const *kernels,
+                                        const fast_params_t *params, const sbox_pool_t *pool,
+                                        fast_cpu_tier_t tier);
+const fast_kernel_t *fast_select_batch_kernel(const fast_kernel_t *const *kernels,
+                                              const fast_params_t *params,
+                                              const sbox_pool_t *pool, fast_cpu_tier_t tier);
+int  fast_compile_program(layer_program_t *prog, const sbox_pool_t *pool, const void *seq,
+                          uint32_t num_layers);
+int  fast_cenc(const fast_kernel_t *kernel, const fast_params_t *params,
+               const layer_program_t *prog, const uint8_t *input, uint8_t *output, size_t length);
+int  fast_cdec(const fast_kernel_t *kernel, const fast_params_t *params,
+               const layer_program_t *prog, const uint8_t *input, uint8_t *output, size_t length);
+int  fast_cenc_batch(const fast_kernel_t *kernel, const fast_params_t *params,
+                     const layer_program_t *prog, const uint8_t *input, uint8_t *output,
+                     size_t length, size_t count);
+int  fast_cdec_batch(const fast_kernel_t *kernel, const fast_params_t *params,
+                     const layer_program_t *prog, const uint8_t *input, uint8_t *output,
+                     size_t length, size_t count);
+int  fast_cenc16(const fast_kernel_t *kernel, const fast_params_t *params,
+                 const layer_program_t *prog, const uint16_t *input, uint16_t *output,
+                 size_t length);
+int  fast_cdec16(const fast_kernel_t *kernel, const fast_params_t *params,
+                 const layer_program_t *prog, const uint16_t *input, uint16_t *output,
+                 size_t length);
 
 // PRNG functions
 int      prng_init(prng_state_t *prng, const uint8_t *key, const uint8_t *nonce);
 void     prng_get_bytes(prng_state_t *prng, uint8_t *output, size_t length);
 uint32_t prng_next_u32(prng_state_t *prng);
 uint32_t prng_uniform(prng_state_t *prng, uint32_t bound);
+// The draws of count calls to prng_uniform() with bounds bound, bound - step, bound - 2 step, ...,
+// of which the last must be at least 1
+void     prng_uniform_batch(prng_state_t *prng, uint32_t bound, uint32_t step, uint32_t *out,
+                            size_t count);
 void     prng_cleanup(prng_state_t *prng);
 
 // Deterministic generation helpers matching the FAST specification
-int fast_generate_sequence(uint32_t *seq, uint32_t seq_length, uint32_t pool_size,
+int fast_generate_sequence(void *seq, uint32_t seq_length, uint32_t pool_size,
                            const uint8_t *key_material, size_t key_len);
 int fast_generate_sbox_pool(sbox_pool_t *pool, uint32_t count, uint32_t radix,
-                            const uint8_t *key_material, size_t key_len);
+                            const uint8_t *key_material, size_t key_len, uint32_t directions,
+                            fast_arena_t *arena);
 
-// PRF functions
-int prf_derive_key(const uint8_t *master_key, const uint8_t *input, size_t input_len,
-                   uint8_t *output, size_t output_len);
+// PRF (prf.c): CMAC-AES-128 under a key expanded once, and a counter-mode KDF over it
+int  prf_init(prf_t *prf, const uint8_t *key);
+void prf_cleanup(prf_t *prf);
+void cmac_begin(cmac_state_t *state);
+int  cmac_update(const prf_t *prf, cmac_state_t *state, const uint8_t *data, size_t len);
+int  cmac_final(const prf_t *prf, const cmac_state_t *state, uint8_t out[FAST_AES_BLOCK_SIZE]);
+// output_len bytes of PRF output over the parts, encoded without being copied together
+int prf_derive(const prf_t *prf, const prf_part_t *parts, size_t count, uint8_t *output,
+               size_t output_len);
+// Same in two steps, for inputs of total parts that start with the same count parts: the state of
+// each of the first blocks of output after those parts, then the output from these states and
+// the remaining parts. output_len must not exceed the blocks states hold.
+int prf_prefix(const prf_t *prf, size_t total, const prf_part_t *parts, size_t count,
+               cmac_state_t *states, size_t blocks);
+int prf_finish(const prf_t *prf, const cmac_state_t *states, size_t blocks,
+               const prf_part_t *parts, size_t count, uint8_t *output, size_t output_len);
 
 #endif // FAST_INTERNAL_H
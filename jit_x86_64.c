@@ -0,0 +1,299 @@
+#define _DEFAULT_SOURCE
+#include "fast_internal.h"
+#include <string.h>
+
+// Per-tweak JIT
+//
+// Once a tweak's layer program is compiled, the whole schedule is fixed: every layer's table
+// address and the three slots it touches are known. fast_jit_compile() turns it into straight-line
+// x86-64 code, one block per layer with the table address as an immediate and the slots as
+// displacements, so running a word is a single call with no loop, no index arithmetic and no table
+// pointer loads. Each direction is a leaf function void fn(uint8_t *data) under the System V ABI,
+// using only rax, rcx, rdx and rsi.
+//
+// Code is written to anonymous read-write pages which are then made read-execute, never both.
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#    define FAST_JIT_X86_64 1
+#endif
+
+#ifdef FAST_JIT_X86_64
+
+#    include <sys/mman.h>
+#    include <unistd.h>
+
+#    ifndef MAP_ANONYMOUS
+#        define MAP_ANONYMOUS MAP_ANON
+#    endif
+
+// Upper bound of the code emitted for one layer, in either direction
+#    define FAST_JIT_LAYER_BYTES 80U
+
+typedef struct {
+    uint8_t *p;
+} emitter_t;
+
+static void
+emit(emitter_t *e, const uint8_t *bytes, size_t len)
+{
+    memcpy(e->p, bytes, len);
+    e->p += len;
+}
+
+static void
+emit_u32(emitter_t *e, uint32_t v)
+{
+    const uint8_t b[4] = { (uint8_t) v, (uint8_t) (v >> 8), (uint8_t) (v >> 16),
+                           (uint8_t) (v >> 24) };
+    emit(e, b, sizeof(b));
+}
+
+// movzx eax|ecx, byte [rdi + slot]
+static void
+emit_load_slot(emitter_t *e, bool ecx, uint32_t slot)
+{
+    const uint8_t op[] = { 0x0F, 0xB6, ecx ? 0x8F : 0x87 };
+    emit(e, op, sizeof(op));
+    emit_u32(e, slot);
+}
+
+// mov byte [rdi + slot], al
+static void
+emit_store_slot(emitter_t *e, uint32_t slot)
+{
+    const uint8_t op[] = { 0x88, 0x87 };
+    emit(e, op, sizeof(op));
+    emit_u32(e, slot);
+}
+
+// movabs rsi, table
+static void
+emit_table(emitter_t *e, const uint8_t *table)
+{
+    const uint8_t op[] = { 0x48, 0xBE };
+    uint64_t      v    = (uint64_t) (uintptr_t) table;
+    emit(e, op, sizeof(op));
+    emit_u32(e, (uint32_t) v);
+    emit_u32(e, (uint32_t) (v >> 32));
+}
+
+// movzx eax, byte [rsi + rax]
+static void
+emit_lookup(emitter_t *e)
+{
+    static const uint8_t op[] = { 0x0F, 0xB6, 0x04, 0x06 };
+    emit(e, op, sizeof(op));
+}
+
+// eax = (eax + ecx) mod radix, for eax and ecx below the radix
+static void
+emit_mod_add(emitter_t *e, uint32_t radix)
+{
+    static const uint8_t add[] = { 0x01, 0xC8 }; // add eax, ecx
+    emit(e, add, sizeof(add));
+    if ((radix & (radix - 1)) == 0) {
+        static const uint8_t and_op[] = { 0x25 }; // and eax, radix - 1
+        emit(e, and_op, sizeof(and_op));
+        emit_u32(e, radix - 1);
+        return;
+    }
+    static const uint8_t lea[]    = { 0x8D, 0x90 }; // lea edx, [rax - radix]
+    static const uint8_t cmp[]    = { 0x3D }; // cmp eax, radix
+    static const uint8_t cmovae[] = { 0x0F, 0x43, 0xC2 }; // cmovae eax, edx
+    emit(e, lea, sizeof(lea));
+    emit_u32(e, (uint32_t) -(int32_t) radix);
+    emit(e, cmp, sizeof(cmp));
+    emit_u32(e, radix);
+    emit(e, cmovae, sizeof(cmovae));
+}
+
+// eax = (eax - ecx) mod radix, for eax and ecx below the radix
+static void
+emit_mod_sub(emitter_t *e, uint32_t radix)
+{
+    static const uint8_t sub[] = { 0x29, 0xC8 }; // sub eax, ecx
+    emit(e, sub, sizeof(sub));
+    if ((radix & (radix - 1)) == 0) {
+        static const uint8_t and_op[] = { 0x25 }; // and eax, radix - 1
+        emit(e, and_op, sizeof(and_op));
+        emit_u32(e, radix - 1);
+        return;
+    }
+    static const uint8_t lea[]   = { 0x8D, 0x90 }; // lea edx, [rax + radix]
+    static const uint8_t cmovs[] = { 0x0F, 0x48, 0xC2 }; // cmovs eax, edx, on the flags of sub
+    emit(e, lea, sizeof(lea));
+    emit_u32(e, radix);
+    emit(e, cmovs, sizeof(cmovs));
+}
+
+static inline uint32_t
+wrap(uint32_t pos, uint32_t ell)
+{
+    return pos >= ell ? pos - ell : pos;
+}
+
+static void
+emit_encrypt(emitter_t *e, const fast_params_t *params, const layer_program_t *prog)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t radix  = params->radix;
+    const uint8_t *tables = prog->enc[FAST_TABLES_PLAIN];
+    const size_t   stride = prog->enc_stride[FAST_TABLES_PLAIN];
+
+    for (uint32_t base = 0; base < prog->num_layers; base += ell) {
+        for (uint32_t j = 0; j < ell; j++) {
+            emit_table(e, layer_table(prog, tables, stride, base + j));
+            emit_load_slot(e, false, j);
+            emit_load_slot(e, true, wrap(j + ell - wp, ell));
+            emit_mod_add(e, radix);
+            emit_lookup(e);
+            if (w > 0) {
+                emit_load_slot(e, true, wrap(j + w, ell));
+                emit_mod_sub(e, radix);
+            }
+            emit_lookup(e);
+            emit_store_slot(e, j);
+        }
+    }
+}
+
+static void
+emit_decrypt(emitter_t *e, const fast_params_t *params, const layer_program_t *prog)
+{
+    const uint32_t ell    = params->word_length;
+    const uint32_t w      = params->branch_dist1;
+    const uint32_t wp     = params->branch_dist2;
+    const uint32_t radix  = params->radix;
+    const uint8_t *tables = prog->dec[FAST_TABLES_PLAIN];
+    const size_t   stride = prog->dec_stride[FAST_TABLES_PLAIN];
+
+    for (uint32_t base = prog->num_layers; base > 0; base -= ell) {
+        for (uint32_t j = ell; j-- > 0;) {
+            emit_table(e, layer_table(prog, tables, stride, base - ell + j));
+            emit_load_slot(e, false, j);
+            emit_lookup(e);
+            if (w > 0) {
+                emit_load_slot(e, true, wrap(j + w, ell));
+                emit_mod_add(e, radix);
+            }
+            emit_lookup(e);
+            emit_load_slot(e, true, wrap(j + ell - wp, ell));
+            emit_mod_sub(e, radix);
+            emit_store_slot(e, j);
+        }
+    }
+}
+
+bool
+fast_jit_available(const fast_params_t *params)
+{
+    return params->radix <= FAST_MAX_RADIX && params->num_layers <= FAST_JIT_MAX_LAYERS;
+}
+
+int
+fast_jit_compile(layer_program_t *prog, const fast_params_t *params)
+{
+    // A direction is compiled when the program holds its tables; the other one stays NULL
+    const bool enc = prog->forward && prog->enc[FAST_TABLES_PLAIN];
+    const bool dec = prog->inverse && prog->dec[FAST_TABLES_PLAIN];
+    if (!fast_jit_available(params) || (!enc && !dec)) {
+        fast_jit_release(prog);
+        return -1;
+    }
+
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t half = ((size_t) prog->num_layers * FAST_JIT_LAYER_BYTES + 1 + page - 1) /
+                        page * page;
+
+    // The code size only depends on the parameters, so a tweak change rewrites the mapping of the
+    // previous tweak in place rather than faulting in fresh pages
+    uint8_t *code = prog->jit_code;
+    prog->jit_enc = NULL;
+    prog->jit_dec = NULL;
+    if (code && prog->jit_size == 2 * half) {
+        if (mprotect(code, 2 * half, PROT_READ | PROT_WRITE) != 0) {
+            fast_jit_release(prog);
+            return -1;
+        }
+    } else {
+        fast_jit_release(prog);
+        code = mmap(NULL, 2 * half, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) {
+            return -1;
+        }
+        prog->jit_code = code;
+        prog->jit_size = 2 * half;
+    }
+
+    static const uint8_t ret[] = { 0xC3 };
+    emitter_t            e     = { code };
+
+    if (enc) {
+        emit_encrypt(&e, params, prog);
+    }
+    emit(&e, ret, sizeof(ret));
+    e.p = code + half;
+    if (dec) {
+        emit_decrypt(&e, params, prog);
+    }
+    emit(&e, ret, sizeof(ret));
+
+    if (mprotect(code, 2 * half, PROT_READ | PROT_EXEC) != 0) {
+        fast_jit_release(prog);
+        return -1;
+    }
+
+    // Casting between object and function pointers is not ISO C, but POSIX requires it to work
+    void *enc_fn = code;
+    void *dec_fn = code + half;
+    if (enc) {
+        memcpy(&prog->jit_enc, &enc_fn, sizeof(enc_fn));
+    }
+    if (dec) {
+        memcpy(&prog->jit_dec, &dec_fn, sizeof(dec_fn));
+    }
+
+    return 0;
+}
+
+void
+fast_jit_release(layer_program_t *prog)
+{
+    if (prog->jit_code) {
+        munmap(prog->jit_code, prog->jit_size);
+    }
+    prog->jit_enc  = NULL;
+    prog->jit_dec  = NULL;
+    prog->jit_code = NULL;
+    prog->jit_size = 0;
+}
+
+#else
+
+bool
+fast_jit_available(const fast_params_t *params)
+{
+    (void) params;
+    return false;
+}
+
+int
+fast_jit_compile(layer_program_t *prog, const fast_params_t *params)
+{
+    (void) params;
+    fast_jit_release(prog);
+    return -1;
+}
+
+void
+fast_jit_release(layer_program_t *prog)
+{
+    prog->jit_enc  = NULL;
+    prog->jit_dec  = NULL;
+    prog->jit_code = NULL;
+    prog->jit_size = 0;
+}
+
+#endif // FAST_JIT_X86_64
@@ -2,30 +2,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-static inline uint8_t
-mod_add(uint32_t a, uint32_t b, uint32_t radix)
-{
-    return (uint8_t) ((a + b) % radix);
-}
-
-static inline uint8_t
-mod_sub(uint32_t a, uint32_t b, uint32_t radix)
-{
-    return (uint8_t) ((a + radix - (b % radix)) % radix);
-}
-
-static inline uint8_t
-add_mod256(uint8_t a, uint8_t b)
-{
-    return (uint8_t) (a + b);
-}
-
-static inline uint8_t
-sub_mod256(uint8_t a, uint8_t b)
-{
-    return (uint8_t) (a - b);
-}
-
 static inline void
 fast_es_layer_radix256(uint8_t *data, uint32_t ell, uint32_t w, uint32_t wp, const sbox_t *sbox)
 {
@@ -156,3 +132,66 @@ fast_ds_layer(const fast_params_t *params, const sbox_pool_t *pool, uint8_t *dat
     memmove(data + 1, data, (ell - 1) * sizeof(uint8_t));
     data[0] = new_first;
 }
+
+// Reference layers on 16-bit symbols, for radices above FAST_MAX_RADIX
+void
+fast_es_layer16(const fast_params_t *params, const sbox_pool_t *pool, uint16_t *data,
+                size_t length, uint32_t sbox_index)
+{
+    if (!params || !pool || !data || length != params->word_length) {
+        return;
+    }
+
+    uint32_t w     = params->branch_dist1;
+    uint32_t wp    = params->branch_dist2;
+    uint32_t ell   = params->word_length;
+    uint32_t radix = params->radix;
+
+    if (!pool->sboxes || sbox_index >= pool->count || !pool->sboxes[sbox_index].perm16) {
+        return;
+    }
+    const uint16_t *perm = pool->sboxes[sbox_index].perm16;
+
+    uint16_t sum1 = perm[mod_add16(data[0], data[ell - wp], radix)];
+    uint16_t new_last;
+    if (w > 0) {
+        new_last = perm[mod_sub16(sum1, data[w], radix)];
+    } else {
+        new_last = perm[sum1];
+    }
+
+    memmove(data, data + 1, (ell - 1) * sizeof(uint16_t));
+    data[ell - 1] = new_last;
+}
+
+void
+fast_ds_layer16(const fast_params_t *params, const sbox_pool_t *pool, uint16_t *data,
+                size_t length, uint32_t sbox_index)
+{
+    if (!params || !pool || !data || length != params->word_length) {
+        return;
+    }
+
+    uint32_t w     = params->branch_dist1;
+    uint32_t wp    = params->branch_dist2;
+    uint32_t ell   = params->word_length;
+    uint32_t radix = params->radix;
+
+    if (!pool->sboxes || sbox_index >= pool->count || !pool->sboxes[sbox_index].inv16) {
+        return;
+    }
+    const uint16_t *inv = pool->sboxes[sbox_index].inv16;
+
+    uint16_t x_last = inv[data[ell - 1]];
+    uint16_t intermediate;
+    if (w > 0) {
+        intermediate = inv[mod_add16(x_last, data[w - 1], radix)];
+    } else {
+        intermediate = inv[x_last];
+    }
+
+    uint16_t new_first = mod_sub16(intermediate, data[ell - wp - 1], radix);
+
+    memmove(data + 1, data, (ell - 1) * sizeof(uint16_t));
+    data[0] = new_first;
+}
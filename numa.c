@@ -0,0 +1,239 @@
+#define _GNU_SOURCE // getcpu, MAP_HUGETLB
+#include "fast_internal.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Memory placement
+//
+// Contexts created with FAST_INIT_HUGE_PAGES or FAST_INIT_NUMA_REPLICAS take their memory from
+// anonymous mappings instead of the heap. Huge pages come from the hugetlb pool when it has any
+// reserved, and otherwise from transparent huge pages where the kernel allows them. Replicas are
+// bound to their node before the pool is written, so the first touch already lands there; the
+// binding is a preference, so a full node falls back to another one instead of failing.
+//
+// Online nodes are read from sysfs once, on first use, under pthread_once() so that no thread can
+// see a partial topology and hand out the wrong replica. Elsewhere than Linux there is a single
+// node and no huge pages, and mappings are plain pages.
+
+#if defined(__unix__) || defined(__APPLE__)
+#    define FAST_MMAP 1
+#    include <sys/mman.h>
+#    include <unistd.h>
+#    ifndef MAP_ANONYMOUS
+#        define MAP_ANONYMOUS MAP_ANON
+#    endif
+#endif
+
+#ifdef __linux__
+#    include <sched.h>
+#    include <sys/syscall.h>
+#    define FAST_MPOL_PREFERRED 1 // MPOL_PREFERRED of <linux/mempolicy.h>
+#endif
+
+static pthread_once_t nodes_once = PTHREAD_ONCE_INIT;
+static uint32_t       node_count = 1;
+static uint32_t       node_ids[FAST_MAX_NUMA_NODES]; // Kernel node id of each index
+static uint32_t       simulated_nodes; // Set by fast_numa_simulate(), 0 when off
+static uint32_t       simulated_node;
+
+#ifdef __linux__
+// Parses a sysfs list such as "0-1,4" into node_ids, up to node id FAST_MAX_NUMA_NODES - 1
+static void
+parse_node_list(const char *list)
+{
+    uint32_t    count = 0;
+    const char *p     = list;
+
+    while (*p >= '0' && *p <= '9' && count < FAST_MAX_NUMA_NODES) {
+        char         *end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last  = first;
+        if (*end == '-') {
+            last = strtoul(end + 1, &end, 10);
+        }
+        for (unsigned long id = first; id <= last && id < FAST_MAX_NUMA_NODES; id++) {
+            node_ids[count++] = (uint32_t) id;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    if (count > 0) {
+        node_count = count;
+    }
+}
+#endif
+
+static void
+read_nodes(void)
+{
+#ifdef __linux__
+    FILE *file = fopen("/sys/devices/system/node/online", "r");
+    if (file) {
+        char list[256];
+        if (fgets(list, sizeof(list), file)) {
+            parse_node_list(list);
+        }
+        fclose(file);
+    }
+#endif
+}
+
+static void
+probe_nodes(void)
+{
+    (void) pthread_once(&nodes_once, read_nodes);
+}
+
+uint32_t
+fast_numa_nodes(void)
+{
+    probe_nodes();
+    return simulated_nodes ? simulated_nodes : node_count;
+}
+
+uint32_t
+fast_numa_node(void)
+{
+    probe_nodes();
+    if (simulated_nodes) {
+        return simulated_node;
+    }
+#ifdef __linux__
+    unsigned int cpu;
+    unsigned int node;
+    if (node_count > 1 && getcpu(&cpu, &node) == 0) {
+        for (uint32_t i = 0; i < node_count; i++) {
+            if (node_ids[i] == node) {
+                return i;
+            }
+        }
+    }
+#endif
+    return 0;
+}
+
+void
+fast_numa_simulate(uint32_t nodes, uint32_t current)
+{
+    probe_nodes();
+    simulated_nodes = nodes < FAST_MAX_NUMA_NODES ? nodes : FAST_MAX_NUMA_NODES;
+    simulated_node  = simulated_nodes && current < simulated_nodes ? current : 0;
+}
+
+#ifdef FAST_MMAP
+
+static size_t
+round_up(size_t bytes, size_t unit)
+{
+    return (bytes + unit - 1) / unit * unit;
+}
+
+// Prefers the node of an index for the pages of a mapping not touched yet; simulated nodes beyond
+// the real ones are left to the default policy
+static void
+bind_pages(void *pages, size_t size, int32_t node)
+{
+#    ifdef __linux__
+    probe_nodes();
+    if (node < 0 || (uint32_t) node >= node_count || node_count == 1) {
+        return;
+    }
+    unsigned long  mask[FAST_MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = { 0 };
+    const uint32_t id = node_ids[node];
+
+    mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+    // Not fatal: the pages then come from wherever the first touch runs
+    (void) syscall(SYS_mbind, pages, size, FAST_MPOL_PREFERRED, mask, 8 * sizeof(mask), 0);
+#    else
+    (void) pages;
+    (void) size;
+    (void) node;
+#    endif
+}
+
+void *
+fast_pages_map(size_t *size, bool huge, int32_t node)
+{
+#    ifdef MAP_HUGETLB
+    if (huge) {
+        const size_t huge_size = round_up(*size, FAST_HUGE_PAGE_SIZE);
+        void        *pages     = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pages != MAP_FAILED) {
+            *size = huge_size;
+            bind_pages(pages, huge_size, node);
+            return pages;
+        }
+    }
+#    endif
+
+    // Transparent huge pages only back whole aligned huge pages of a mapping, so a huge mapping is
+    // taken in whole huge pages, from a larger one trimmed to alignment
+    const size_t unit   = huge ? FAST_HUGE_PAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE);
+    const size_t length = round_up(*size, unit);
+    const size_t extra  = huge ? FAST_HUGE_PAGE_SIZE : 0;
+    uint8_t     *start  = mmap(NULL, length + extra, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (start == MAP_FAILED) {
+        return NULL;
+    }
+    if (huge) {
+        const size_t skew = (FAST_HUGE_PAGE_SIZE - (uintptr_t) start % FAST_HUGE_PAGE_SIZE) %
+                            FAST_HUGE_PAGE_SIZE;
+        if (skew > 0) {
+            munmap(start, skew);
+        }
+        if (extra > skew) {
+            munmap(start + skew + length, extra - skew);
+        }
+        start += skew;
+#    ifdef MADV_HUGEPAGE
+        (void) madvise(start, length, MADV_HUGEPAGE);
+#    endif
+    }
+    *size = length;
+    bind_pages(start, length, node);
+    return start;
+}
+
+void
+fast_pages_unmap(void *pages, size_t size)
+{
+    if (pages) {
+        munmap(pages, size);
+    }
+}
+
+int
+fast_pages_protect(void *pages, size_t size, bool writable)
+{
+    return mprotect(pages, size, writable ? PROT_READ | PROT_WRITE : PROT_READ);
+}
+
+#else
+
+void *
+fast_pages_map(size_t *size, bool huge, int32_t node)
+{
+    (void) huge;
+    (void) node;
+    return malloc(*size);
+}
+
+void
+fast_pages_unmap(void *pages, size_t size)
+{
+    (void) size;
+    free(pages);
+}
+
+int
+fast_pages_protect(void *pages, size_t size, bool writable)
+{
+    (void) pages;
+    (void) size;
+    (void) writable;
+    return 0;
+}
+
+#endif // FAST_MMAP
@@ -1,93 +1,221 @@
 #include "fast_internal.h"
-#include <openssl/core_names.h>
 #include <openssl/evp.h>
-#include <openssl/params.h>
 #include <string.h>
 
+// CMAC-AES-128 (RFC 4493)
+//
+// The PRF is CMAC under the master key. A prf_t expands the key once into an AES-128-ECB context
+// and derives the two subkeys, so that a MAC only costs one block encryption per 16 input bytes:
+// the chaining is done here, XOR-ing each block into the chaining value before encrypting it. The
+// last block is kept back until cmac_final(), which masks it with K1 when complete and pads it and
+// masks it with K2 otherwise.
+
+static int
+encrypt_block(const prf_t *prf, const uint8_t in[FAST_AES_BLOCK_SIZE],
+              uint8_t out[FAST_AES_BLOCK_SIZE])
+{
+    int out_len = 0;
+    if (EVP_EncryptUpdate(prf->aes, out, &out_len, in, FAST_AES_BLOCK_SIZE) != 1 ||
+        out_len != FAST_AES_BLOCK_SIZE) {
+        return -1;
+    }
+    return 0;
+}
+
+// Doubling in GF(2^128), as used to derive the subkeys
+static void
+double_block(const uint8_t in[FAST_AES_BLOCK_SIZE], uint8_t out[FAST_AES_BLOCK_SIZE])
+{
+    const uint8_t carry = in[0] >> 7;
+    for (size_t i = 0; i + 1 < FAST_AES_BLOCK_SIZE; i++) {
+        out[i] = (uint8_t) ((in[i] << 1) | (in[i + 1] >> 7));
+    }
+    out[FAST_AES_BLOCK_SIZE - 1] = (uint8_t) ((in[FAST_AES_BLOCK_SIZE - 1] << 1) ^ (carry * 0x87));
+}
+
 int
-prf_derive_key(const uint8_t *master_key, const uint8_t *input, size_t input_len, uint8_t *output,
-               size_t output_len)
+prf_init(prf_t *prf, const uint8_t *key)
 {
-    if (!master_key || !input || !output || output_len == 0) {
+    if (!prf || !key) {
         return -1;
     }
 
-    size_t   bytes_generated = 0;
-    uint32_t counter         = 0;
+    memset(prf, 0, sizeof(*prf));
+    prf->aes = EVP_CIPHER_CTX_new();
+    if (!prf->aes) {
+        return -1;
+    }
 
-    // Create the MAC context once
-    EVP_MAC *mac = EVP_MAC_fetch(NULL, "CMAC", NULL);
-    if (!mac) {
+    uint8_t zero[FAST_AES_BLOCK_SIZE] = { 0 };
+    uint8_t l[FAST_AES_BLOCK_SIZE];
+    if (EVP_EncryptInit_ex(prf->aes, EVP_aes_128_ecb(), NULL, key, NULL) != 1 ||
+        EVP_CIPHER_CTX_set_padding(prf->aes, 0) != 1 || encrypt_block(prf, zero, l) != 0) {
+        prf_cleanup(prf);
         return -1;
     }
+    double_block(l, prf->k1);
+    double_block(prf->k1, prf->k2);
+    memset(l, 0, sizeof(l));
 
-    while (bytes_generated < output_len) {
-        size_t  cmac_len = FAST_AES_BLOCK_SIZE;
-        uint8_t cmac_output[FAST_AES_BLOCK_SIZE];
+    return 0;
+}
 
-        // Prepare input: counter || input
-        size_t   total_input_len = 4 + input_len;
-        uint8_t *cmac_input      = malloc(total_input_len);
-        if (!cmac_input) {
-            EVP_MAC_free(mac);
-            return -1;
-        }
+void
+prf_cleanup(prf_t *prf)
+{
+    if (!prf) {
+        return;
+    }
+    // Freeing the cipher context also wipes the expanded key
+    EVP_CIPHER_CTX_free(prf->aes);
+    memset(prf, 0, sizeof(*prf));
+}
 
-        // Big-endian counter
-        cmac_input[0] = (counter >> 24) & 0xFF;
-        cmac_input[1] = (counter >> 16) & 0xFF;
-        cmac_input[2] = (counter >> 8) & 0xFF;
-        cmac_input[3] = counter & 0xFF;
-        memcpy(cmac_input + 4, input, input_len);
-
-        // Create MAC context
-        EVP_MAC_CTX *ctx = EVP_MAC_CTX_new(mac);
-        if (!ctx) {
-            free(cmac_input);
-            EVP_MAC_free(mac);
-            return -1;
+void
+cmac_begin(cmac_state_t *state)
+{
+    memset(state, 0, sizeof(*state));
+}
+
+int
+cmac_update(const prf_t *prf, cmac_state_t *state, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        // A full pending block is only processed once more input shows it is not the last one
+        if (state->pending_len == FAST_AES_BLOCK_SIZE) {
+            for (size_t i = 0; i < FAST_AES_BLOCK_SIZE; i++) {
+                state->chain[i] ^= state->pending[i];
+            }
+            if (encrypt_block(prf, state->chain, state->chain) != 0) {
+                return -1;
+            }
+            state->pending_len = 0;
         }
 
-        // Set up parameters for CMAC with AES-128-CBC
-        OSSL_PARAM params[] = { OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_CIPHER,
-                                                                 "AES-128-CBC", 0),
-                                OSSL_PARAM_construct_end() };
+        const size_t room = FAST_AES_BLOCK_SIZE - state->pending_len;
+        const size_t take = len < room ? len : room;
+        memcpy(state->pending + state->pending_len, data, take);
+        state->pending_len += take;
+        data += take;
+        len -= take;
+    }
+    return 0;
+}
 
-        // Initialize with key
-        if (EVP_MAC_init(ctx, master_key, FAST_AES_KEY_SIZE, params) != 1) {
-            EVP_MAC_CTX_free(ctx);
-            free(cmac_input);
-            EVP_MAC_free(mac);
-            return -1;
-        }
+int
+cmac_final(const prf_t *prf, const cmac_state_t *state, uint8_t out[FAST_AES_BLOCK_SIZE])
+{
+    const bool     complete = state->pending_len == FAST_AES_BLOCK_SIZE;
+    const uint8_t *subkey   = complete ? prf->k1 : prf->k2;
+    uint8_t        last[FAST_AES_BLOCK_SIZE];
 
-        // Update with data
-        if (EVP_MAC_update(ctx, cmac_input, total_input_len) != 1) {
-            EVP_MAC_CTX_free(ctx);
-            free(cmac_input);
-            EVP_MAC_free(mac);
+    memcpy(last, state->pending, state->pending_len);
+    if (!complete) {
+        last[state->pending_len] = 0x80;
+        memset(last + state->pending_len + 1, 0, FAST_AES_BLOCK_SIZE - state->pending_len - 1);
+    }
+    for (size_t i = 0; i < FAST_AES_BLOCK_SIZE; i++) {
+        last[i] ^= subkey[i] ^ state->chain[i];
+    }
+    return encrypt_block(prf, last, out);
+}
+
+// Adds parts to a MAC in progress, each as be32(len) || data
+static int
+absorb_parts(const prf_t *prf, cmac_state_t *state, const prf_part_t *parts, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint8_t len_be[4];
+        write_u32_be((uint32_t) parts[i].len, len_be);
+        if (cmac_update(prf, state, len_be, sizeof(len_be)) != 0 ||
+            (parts[i].len > 0 && cmac_update(prf, state, parts[i].data, parts[i].len) != 0)) {
             return -1;
         }
+    }
+    return 0;
+}
 
-        // Finalize and get output
-        if (EVP_MAC_final(ctx, cmac_output, &cmac_len, sizeof(cmac_output)) != 1) {
-            EVP_MAC_CTX_free(ctx);
-            free(cmac_input);
-            EVP_MAC_free(mac);
+// Starts output block counter of an input of total parts: be32(counter) || be32(total)
+static int
+start_block(const prf_t *prf, cmac_state_t *state, uint32_t counter, size_t total)
+{
+    uint8_t header[8];
+    write_u32_be(counter, header);
+    write_u32_be((uint32_t) total, header + 4);
+    cmac_begin(state);
+    return cmac_update(prf, state, header, sizeof(header));
+}
+
+// Counter mode over the MAC: output block i is CMAC(be32(i) || be32(total) || the parts, each as
+// be32(len) || data). The state of each block after its first parts can be kept with prf_prefix()
+// and resumed with prf_finish(), so that inputs sharing those parts only pay for the others.
+int
+prf_prefix(const prf_t *prf, size_t total, const prf_part_t *parts, size_t count,
+           cmac_state_t *states, size_t blocks)
+{
+    if (!prf || !prf->aes || (!parts && count > 0) || count > total || !states) {
+        return -1;
+    }
+    for (size_t i = 0; i < blocks; i++) {
+        if (start_block(prf, &states[i], (uint32_t) i, total) != 0 ||
+            absorb_parts(prf, &states[i], parts, count) != 0) {
             return -1;
         }
+    }
+    return 0;
+}
+
+int
+prf_finish(const prf_t *prf, const cmac_state_t *states, size_t blocks, const prf_part_t *parts,
+           size_t count, uint8_t *output, size_t output_len)
+{
+    if (!prf || !prf->aes || !states || (!parts && count > 0) || !output ||
+        output_len > blocks * FAST_AES_BLOCK_SIZE) {
+        return -1;
+    }
 
-        EVP_MAC_CTX_free(ctx);
-        free(cmac_input);
+    cmac_state_t state;
+    uint8_t      block[FAST_AES_BLOCK_SIZE];
+    int          status = 0;
+    for (size_t i = 0; output_len > 0; i++) {
+        state = states[i];
+        if (absorb_parts(prf, &state, parts, count) != 0 || cmac_final(prf, &state, block) != 0) {
+            status = -1;
+            break;
+        }
+        const size_t take = output_len < sizeof(block) ? output_len : sizeof(block);
+        memcpy(output, block, take);
+        output += take;
+        output_len -= take;
+    }
+    memset(&state, 0, sizeof(state));
+    memset(block, 0, sizeof(block));
+    return status;
+}
 
-        // Copy output
-        size_t to_copy =
-            (output_len - bytes_generated < cmac_len) ? (output_len - bytes_generated) : cmac_len;
-        memcpy(output + bytes_generated, cmac_output, to_copy);
-        bytes_generated += to_copy;
-        counter++;
+int
+prf_derive(const prf_t *prf, const prf_part_t *parts, size_t count, uint8_t *output,
+           size_t output_len)
+{
+    if (!prf || !prf->aes || (!parts && count > 0) || !output || output_len == 0) {
+        return -1;
     }
 
-    EVP_MAC_free(mac);
-    return 0;
+    cmac_state_t state;
+    uint8_t      block[FAST_AES_BLOCK_SIZE];
+    int          status = 0;
+    for (uint32_t i = 0; output_len > 0; i++) {
+        if (start_block(prf, &state, i, count) != 0 ||
+            absorb_parts(prf, &state, parts, count) != 0 || cmac_final(prf, &state, block) != 0) {
+            status = -1;
+            break;
+        }
+        const size_t take = output_len < sizeof(block) ? output_len : sizeof(block);
+        memcpy(output, block, take);
+        output += take;
+        output_len -= take;
+    }
+    memset(&state, 0, sizeof(state));
+    memset(block, 0, sizeof(block));
+    return status;
 }
@@ -1,6 +1,10 @@
 #include "fast_internal.h"
 #include <string.h>
 
+#ifdef __SSE2__
+#    include <emmintrin.h>
+#endif
+
 static void
 increment_counter(uint8_t *counter)
 {
@@ -18,32 +22,42 @@ prng_init(prng_state_t *prng, const uint8_t *key, const uint8_t *nonce)
         return -1;
     }
 
+    // OpenSSL's CTR mode increments the whole block as a big-endian integer, as the counter of
+    // this PRNG always has, so starting it one past the nonce gives the same keystream
+    uint8_t counter[FAST_AES_BLOCK_SIZE];
+    memcpy(counter, nonce, FAST_AES_BLOCK_SIZE);
+    increment_counter(counter);
+
     prng->ctx = EVP_CIPHER_CTX_new();
     if (!prng->ctx) {
         return -1;
     }
 
-    if (EVP_EncryptInit_ex(prng->ctx, EVP_aes_128_ecb(), NULL, key, NULL) != 1) {
-        EVP_CIPHER_CTX_free(prng->ctx);
-        prng->ctx = NULL;
-        return -1;
-    }
-
-    if (EVP_CIPHER_CTX_set_padding(prng->ctx, 0) != 1) {
+    if (EVP_EncryptInit_ex(prng->ctx, EVP_aes_128_ctr(), NULL, key, counter) != 1) {
         EVP_CIPHER_CTX_free(prng->ctx);
         prng->ctx = NULL;
+        memset(counter, 0, sizeof(counter));
         return -1;
     }
-    memset(prng->counter, 0, FAST_AES_BLOCK_SIZE);
+    memset(counter, 0, sizeof(counter));
 
-    if (nonce) {
-        memcpy(prng->counter, nonce, FAST_AES_BLOCK_SIZE);
-    }
+    prng->buffer_pos = FAST_PRNG_BUFFER_SIZE;
+    return 0;
+}
 
-    memset(prng->buffer, 0, FAST_AES_BLOCK_SIZE);
-    prng->buffer_pos = FAST_AES_BLOCK_SIZE;
+// Generates the next FAST_PRNG_BUFFER_SIZE bytes of keystream, or zeroes on failure
+static void
+refill(prng_state_t *prng)
+{
+    int out_len = 0;
 
-    return 0;
+    memset(prng->buffer, 0, FAST_PRNG_BUFFER_SIZE);
+    if (EVP_EncryptUpdate(prng->ctx, prng->buffer, &out_len, prng->buffer,
+                          FAST_PRNG_BUFFER_SIZE) != 1 ||
+        out_len != FAST_PRNG_BUFFER_SIZE) {
+        memset(prng->buffer, 0, FAST_PRNG_BUFFER_SIZE);
+    }
+    prng->buffer_pos = 0;
 }
 
 void
@@ -56,20 +70,11 @@ prng_get_bytes(prng_state_t *prng, uint8_t *output, size_t length)
     size_t bytes_copied = 0;
 
     while (bytes_copied < length) {
-        if (prng->buffer_pos >= FAST_AES_BLOCK_SIZE) {
-            increment_counter(prng->counter);
-            int out_len = 0;
-            if (EVP_EncryptUpdate(prng->ctx, prng->buffer, &out_len, prng->counter,
-                                  FAST_AES_BLOCK_SIZE) != 1 ||
-                out_len != FAST_AES_BLOCK_SIZE) {
-                memset(prng->buffer, 0, FAST_AES_BLOCK_SIZE);
-                prng->buffer_pos = FAST_AES_BLOCK_SIZE;
-                return;
-            }
-            prng->buffer_pos = 0;
+        if (prng->buffer_pos >= FAST_PRNG_BUFFER_SIZE) {
+            refill(prng);
         }
 
-        size_t available = FAST_AES_BLOCK_SIZE - prng->buffer_pos;
+        size_t available = FAST_PRNG_BUFFER_SIZE - prng->buffer_pos;
         size_t to_copy = (length - bytes_copied < available) ? (length - bytes_copied) : available;
 
         memcpy(output + bytes_copied, prng->buffer + prng->buffer_pos, to_copy);
@@ -85,12 +90,21 @@ prng_next_u32(prng_state_t *prng)
         return 0;
     }
 
+    // Straight from the buffer unless the word straddles a refill
+    if (FAST_PRNG_BUFFER_SIZE - prng->buffer_pos >= sizeof(uint32_t)) {
+        const uint32_t value = read_u32_be(prng->buffer + prng->buffer_pos);
+        prng->buffer_pos += sizeof(uint32_t);
+        return value;
+    }
+
     uint8_t bytes[4];
     prng_get_bytes(prng, bytes, sizeof(bytes));
-    return ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) | ((uint32_t) bytes[2] << 8) |
-           ((uint32_t) bytes[3]);
+    return read_u32_be(bytes);
 }
 
+// Lemire's multiply-high: the draw is the high half of r * bound, rejected when the low half is
+// below 2^32 mod bound. That threshold is below the bound, so it only needs computing, with a
+// division, when the low half is.
 uint32_t
 prng_uniform(prng_state_t *prng, uint32_t bound)
 {
@@ -98,20 +112,121 @@ prng_uniform(prng_state_t *prng, uint32_t bound)
         return 0;
     }
 
-    const uint64_t bound64   = (uint64_t) bound;
-    const uint32_t threshold = (uint32_t) ((0u - bound) % bound);
-    uint32_t       r, low;
-    uint64_t       product;
+    uint64_t product;
+    uint32_t low;
 
     do {
-        r       = prng_next_u32(prng);
-        product = (uint64_t) r * bound64;
+        product = (uint64_t) prng_next_u32(prng) * bound;
         low     = (uint32_t) product;
-    } while (low < threshold);
+    } while (low < bound && low < (0U - bound) % bound);
 
     return (uint32_t) (product >> 32);
 }
 
+#ifdef __SSE2__
+// Draws from four keystream words at once, below bound, bound - step, bound - 2 step and
+// bound - 3 step. Returns a mask of those whose low half is below their bound, which may have to
+// be rejected; the others are final.
+static unsigned
+screen4(const uint8_t *bytes, uint32_t bound, uint32_t step, uint32_t *out)
+{
+    const __m128i sign   = _mm_set1_epi32(INT32_MIN);
+    const __m128i high   = _mm_set_epi32(-1, 0, -1, 0);
+    const __m128i bounds = _mm_set_epi32((int32_t) (bound - 3 * step), (int32_t) (bound - 2 * step),
+                                         (int32_t) (bound - step), (int32_t) bound);
+    __m128i       r      = _mm_loadu_si128((const __m128i *) (const void *) bytes);
+
+    // Big-endian words: swap the bytes of each half, then the halves
+    r = _mm_or_si128(_mm_slli_epi16(r, 8), _mm_srli_epi16(r, 8));
+    r = _mm_shufflehi_epi16(_mm_shufflelo_epi16(r, 0xB1), 0xB1);
+
+    const __m128i even = _mm_mul_epu32(r, bounds);
+    const __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(r, 32), _mm_srli_epi64(bounds, 32));
+    const __m128i hi   = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_and_si128(odd, high));
+    const __m128i lo   = _mm_or_si128(_mm_andnot_si128(high, even), _mm_slli_epi64(odd, 32));
+    const __m128i low  = _mm_cmplt_epi32(_mm_xor_si128(lo, sign), _mm_xor_si128(bounds, sign));
+
+    _mm_storeu_si128((__m128i *) (void *) out, hi);
+    return (unsigned) _mm_movemask_ps(_mm_castsi128_ps(low));
+}
+#endif
+
+// Draws of prng_uniform_batch() from the buffered keystream, as many as it holds words for
+static size_t
+draw_buffered(prng_state_t *prng, uint32_t bound, uint32_t step, uint32_t *out, size_t count)
+{
+    const uint8_t *bytes = prng->buffer + prng->buffer_pos;
+    const size_t   words = (FAST_PRNG_BUFFER_SIZE - prng->buffer_pos) / sizeof(uint32_t);
+    size_t         drawn = 0;
+    size_t         used  = 0;
+
+    while (drawn < count && used < words) {
+        const uint32_t b = bound - (uint32_t) drawn * step;
+#ifdef __SSE2__
+        if (count - drawn >= 4 && words - used >= 4 &&
+            screen4(bytes + used * sizeof(uint32_t), b, step, out + drawn) == 0) {
+            drawn += 4;
+            used += 4;
+            continue;
+        }
+#endif
+        // One word at a time around a possible rejection
+        const uint64_t product = (uint64_t) read_u32_be(bytes + used * sizeof(uint32_t)) * b;
+        const uint32_t low     = (uint32_t) product;
+        used++;
+        if (low < b && low < (0U - b) % b) {
+            continue;
+        }
+        out[drawn++] = (uint32_t) (product >> 32);
+    }
+
+    prng->buffer_pos += used * sizeof(uint32_t);
+    return drawn;
+}
+
+// A power-of-two bound never rejects, as 2^32 mod bound is 0: each draw is the top bits of a word
+static size_t
+draw_power_of_two(prng_state_t *prng, uint32_t bound, uint32_t *out, size_t count)
+{
+    const uint8_t *bytes = prng->buffer + prng->buffer_pos;
+    const size_t   words = (FAST_PRNG_BUFFER_SIZE - prng->buffer_pos) / sizeof(uint32_t);
+    const size_t   n     = count < words ? count : words;
+
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (uint32_t) (((uint64_t) read_u32_be(bytes + i * sizeof(uint32_t)) * bound) >> 32);
+    }
+    prng->buffer_pos += n * sizeof(uint32_t);
+    return n;
+}
+
+void
+prng_uniform_batch(prng_state_t *prng, uint32_t bound, uint32_t step, uint32_t *out, size_t count)
+{
+    if (!prng || !out || count == 0 || bound == 0 || (uint64_t) (count - 1) * step >= bound) {
+        return;
+    }
+
+    while (count > 0) {
+        if (prng->buffer_pos >= FAST_PRNG_BUFFER_SIZE) {
+            refill(prng);
+        }
+
+        size_t drawn;
+        if (FAST_PRNG_BUFFER_SIZE - prng->buffer_pos < sizeof(uint32_t)) {
+            // A word straddling a refill, after reads of other lengths through prng_get_bytes()
+            *out  = prng_uniform(prng, bound);
+            drawn = 1;
+        } else if (step == 0 && (bound & (bound - 1)) == 0) {
+            drawn = draw_power_of_two(prng, bound, out, count);
+        } else {
+            drawn = draw_buffered(prng, bound, step, out, count);
+        }
+        out += drawn;
+        count -= drawn;
+        bound -= (uint32_t) drawn * step;
+    }
+}
+
 void
 prng_cleanup(prng_state_t *prng)
 {
@@ -123,9 +238,8 @@ prng_cleanup(prng_state_t *prng)
         EVP_CIPHER_CTX_free(prng->ctx);
         prng->ctx = NULL;
     }
-    memset(prng->counter, 0, FAST_AES_BLOCK_SIZE);
-    memset(prng->buffer, 0, FAST_AES_BLOCK_SIZE);
-    prng->buffer_pos = 0;
+    memset(prng->buffer, 0, FAST_PRNG_BUFFER_SIZE);
+    prng->buffer_pos = FAST_PRNG_BUFFER_SIZE;
 }
 
 static void
@@ -140,12 +254,13 @@ split_key_material(const uint8_t *key_material, uint8_t *key_out, uint8_t *iv_ou
     }
 }
 
+// Entries are seq_entry_size(pool_size) bytes wide
 int
-fast_generate_sequence(uint32_t *seq, uint32_t seq_length, uint32_t pool_size,
+fast_generate_sequence(void *seq, uint32_t seq_length, uint32_t pool_size,
                        const uint8_t *key_material, size_t key_len)
 {
-    if (!seq || seq_length == 0 || pool_size == 0 || !key_material ||
-        key_len < FAST_DERIVED_KEY_SIZE) {
+    if (!seq || seq_length == 0 || pool_size == 0 || pool_size > FAST_MAX_SBOX_COUNT ||
+        !key_material || key_len < FAST_DERIVED_KEY_SIZE) {
         return -1;
     }
 
@@ -160,11 +275,23 @@ fast_generate_sequence(uint32_t *seq, uint32_t seq_length, uint32_t pool_size,
         return -1;
     }
 
-    for (uint32_t i = 0; i < seq_length; i++) {
-        seq[i] = prng_uniform(&prng, pool_size);
+    uint8_t  *seq8  = seq;
+    uint16_t *seq16 = seq;
+    uint32_t  draws[FAST_PRNG_DRAWS];
+    for (uint32_t i = 0; i < seq_length;) {
+        const uint32_t n = seq_length - i < FAST_PRNG_DRAWS ? seq_length - i : FAST_PRNG_DRAWS;
+        prng_uniform_batch(&prng, pool_size, 0, draws, n);
+        for (uint32_t k = 0; k < n; k++, i++) {
+            if (seq_entry_size(pool_size) == sizeof(uint8_t)) {
+                seq8[i] = (uint8_t) draws[k];
+            } else {
+                seq16[i] = (uint16_t) draws[k];
+            }
+        }
     }
 
     prng_cleanup(&prng);
+    memset(draws, 0, sizeof(draws));
     memset(key, 0, sizeof(key));
     memset(iv, 0, sizeof(iv));
     return 0;
@@ -172,7 +299,8 @@ fast_generate_sequence(uint32_t *seq, uint32_t seq_length, uint32_t pool_size,
 
 int
 fast_generate_sbox_pool(sbox_pool_t *pool, uint32_t count, uint32_t radix,
-                        const uint8_t *key_material, size_t key_len)
+                        const uint8_t *key_material, size_t key_len, uint32_t directions,
+                        fast_arena_t *arena)
 {
     if (!pool || !key_material || key_len < FAST_DERIVED_KEY_SIZE) {
         return -1;
@@ -189,7 +317,7 @@ fast_generate_sbox_pool(sbox_pool_t *pool, uint32_t count, uint32_t radix,
         return -1;
     }
 
-    int ret = generate_sbox_pool(pool, count, radix, &prng);
+    int ret = generate_sbox_pool(pool, count, radix, &prng, directions, arena);
     prng_cleanup(&prng);
     memset(key, 0, sizeof(key));
     memset(iv, 0, sizeof(iv));
@@ -1,104 +1,376 @@
+#define _POSIX_C_SOURCE 200112L // posix_memalign
 #include "fast_internal.h"
 #include <stdlib.h>
 #include <string.h>
 
-static int
-allocate_sbox_arrays(sbox_t *sbox, uint32_t radix)
+// Fisher-Yates shuffle of the identity, on entries of width bytes (uint8_t or uint16_t)
+static void
+shuffle_table(uint8_t *perm, uint32_t radix, size_t width, prng_state_t *prng)
+{
+    uint16_t *perm16 = (uint16_t *) (void *) perm;
+    uint32_t  draws[FAST_PRNG_DRAWS];
+
+    for (uint32_t i = 0; i < radix; i++) {
+        if (width == sizeof(uint16_t)) {
+            perm16[i] = (uint16_t) i;
+        } else {
+            perm[i] = (uint8_t) i;
+        }
+    }
+
+    for (uint32_t i = radix; i > 1;) {
+        const uint32_t n = i - 1 < FAST_PRNG_DRAWS ? i - 1 : FAST_PRNG_DRAWS;
+        prng_uniform_batch(prng, i, 1, draws, n);
+        for (uint32_t k = 0; k < n; k++, i--) {
+            const uint32_t j = draws[k];
+            if (width == sizeof(uint16_t)) {
+                const uint16_t temp = perm16[i - 1];
+                perm16[i - 1]       = perm16[j];
+                perm16[j]           = temp;
+            } else {
+                const uint8_t temp = perm[i - 1];
+                perm[i - 1]        = perm[j];
+                perm[j]            = temp;
+            }
+        }
+    }
+    memset(draws, 0, sizeof(draws));
+}
+
+// Inverse of a table of either width
+static void
+invert_sbox(const uint8_t *perm, uint8_t *inv, uint32_t radix)
 {
-    sbox->perm = malloc(radix * sizeof(uint8_t));
-    if (!sbox->perm) {
+    if (radix > FAST_MAX_RADIX) {
+        const uint16_t *perm16 = (const uint16_t *) (const void *) perm;
+        uint16_t       *inv16  = (uint16_t *) (void *) inv;
+        for (uint32_t i = 0; i < radix; i++) {
+            inv16[perm16[i]] = (uint16_t) i;
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < radix; i++) {
+        inv[perm[i]] = (uint8_t) i;
+    }
+}
+
+// Standalone S-box with its own arrays; S-boxes of a pool live in its slabs instead
+int
+generate_sbox(sbox_t *sbox, uint32_t radix, prng_state_t *prng)
+{
+    if (!sbox || radix == 0 || radix > FAST_MAX_RADIX16 || !prng) {
         return -1;
     }
 
-    sbox->inv = malloc(radix * sizeof(uint8_t));
-    if (!sbox->inv) {
-        free(sbox->perm);
-        sbox->perm = NULL;
+    const size_t size = radix > FAST_MAX_RADIX ? sizeof(uint16_t) : sizeof(uint8_t);
+    uint8_t     *perm = malloc(radix * size);
+    uint8_t     *inv  = malloc(radix * size);
+    if (!perm || !inv) {
+        free(perm);
+        free(inv);
         return -1;
     }
 
+    shuffle_table(perm, radix, size, prng);
+    invert_sbox(perm, inv, radix);
+
+    memset(sbox, 0, sizeof(*sbox));
     sbox->radix = radix;
+    if (radix > FAST_MAX_RADIX) {
+        sbox->perm16 = (uint16_t *) (void *) perm;
+        sbox->inv16  = (uint16_t *) (void *) inv;
+    } else {
+        sbox->perm = perm;
+        sbox->inv  = inv;
+    }
+
     return 0;
 }
 
-int
-generate_sbox(sbox_t *sbox, uint32_t radix, prng_state_t *prng)
+// Zeroed, cache-aligned block of the pool, carved from its arena if it has one
+static void *
+pool_alloc(const sbox_pool_t *pool, size_t bytes)
 {
-    if (!sbox || radix == 0 || radix > FAST_MAX_RADIX || !prng) {
-        return -1;
+    void *block = NULL;
+
+    if (pool->arena) {
+        block = arena_alloc(pool->arena, bytes);
+    } else if (posix_memalign(&block, FAST_CACHE_LINE, bytes) != 0) {
+        block = NULL;
+    }
+    if (block) {
+        memset(block, 0, bytes);
+    }
+    return block;
+}
+
+static void
+pool_free(const sbox_pool_t *pool, void *block)
+{
+    if (!pool->arena) {
+        free(block);
     }
+}
+
+// Slab of one table per S-box: the vector kernels load the zero padding along with each table
+static uint8_t *
+alloc_slab(const sbox_pool_t *pool)
+{
+    return pool_alloc(pool, (size_t) pool->count * pool->sbox_stride);
+}
+
+// Forward fused tables are only built while they fit their budget
+static bool
+fused_enc_fits(uint32_t count, uint32_t radix)
+{
+    const size_t table = (size_t) radix << FAST_FUSED_SHIFT;
+    return radix <= FAST_FUSED_MAX_RADIX && (size_t) count * 2 * table <= FAST_FUSED_ENC_BUDGET;
+}
+
+// Points the S-boxes at their tables in the slabs built so far
+static void
+link_sboxes(sbox_pool_t *pool)
+{
+    const bool wide = pool->radix > FAST_MAX_RADIX;
 
-    if (allocate_sbox_arrays(sbox, radix) != 0) {
+    for (uint32_t i = 0; i < pool->count; i++) {
+        sbox_t  *sbox = &pool->sboxes[i];
+        uint8_t *perm = pool->perm_slab ? pool->perm_slab + (size_t) i * pool->sbox_stride : NULL;
+        uint8_t *inv  = pool->inv_slab ? pool->inv_slab + (size_t) i * pool->sbox_stride : NULL;
+
+        sbox->radix  = pool->radix;
+        sbox->perm   = wide ? NULL : perm;
+        sbox->inv    = wide ? NULL : inv;
+        sbox->perm16 = wide ? (uint16_t *) (void *) perm : NULL;
+        sbox->inv16  = wide ? (uint16_t *) (void *) inv : NULL;
+    }
+}
+
+static int
+build_fused_enc(sbox_pool_t *pool)
+{
+    const uint32_t radix = pool->radix;
+    const size_t   table = (size_t) radix << FAST_FUSED_SHIFT;
+
+    if (!fused_enc_fits(pool->count, radix)) {
+        return 0;
+    }
+    pool->fused_enc = pool_alloc(pool, (size_t) pool->count * 2 * table);
+    if (!pool->fused_enc) {
         return -1;
     }
 
-    for (uint32_t i = 0; i < radix; i++) {
-        sbox->perm[i] = (uint8_t) i;
+    for (uint32_t i = 0; i < pool->count; i++) {
+        const uint8_t *perm    = pool->sboxes[i].perm;
+        uint8_t       *enc_add = pool->fused_enc + (size_t) i * 2 * table;
+        uint8_t       *enc_sub = enc_add + table;
+
+        for (uint32_t x = 0; x < radix; x++) {
+            for (uint32_t y = 0; y < radix; y++) {
+                uint32_t at = (x << FAST_FUSED_SHIFT) | y;
+                enc_add[at] = (uint8_t) (perm[mod_add(x, y, radix)] << FAST_FUSED_SHIFT);
+                enc_sub[at] = perm[mod_sub(x, y, radix)];
+            }
+        }
     }
 
-    for (uint32_t i = radix; i > 1; i--) {
-        uint32_t j        = prng_uniform(prng, i);
-        uint8_t  temp     = sbox->perm[i - 1];
-        sbox->perm[i - 1] = sbox->perm[j];
-        sbox->perm[j]     = temp;
+    return 0;
+}
+
+static int
+build_fused_dec(sbox_pool_t *pool)
+{
+    const uint32_t radix = pool->radix;
+    const size_t   table = (size_t) radix << FAST_FUSED_SHIFT;
+
+    pool->fused_dec = pool_alloc(pool, (size_t) pool->count * table);
+    if (!pool->fused_dec) {
+        return -1;
     }
 
-    for (uint32_t i = 0; i < radix; i++) {
-        sbox->inv[sbox->perm[i]] = (uint8_t) i;
+    for (uint32_t i = 0; i < pool->count; i++) {
+        const uint8_t *inv     = pool->sboxes[i].inv;
+        uint8_t       *dec_add = pool->fused_dec + (size_t) i * table;
+
+        for (uint32_t x = 0; x < radix; x++) {
+            for (uint32_t y = 0; y < radix; y++) {
+                dec_add[(x << FAST_FUSED_SHIFT) | y] = inv[mod_add(x, y, radix)];
+            }
+        }
     }
 
     return 0;
 }
 
 int
-generate_sbox_pool(sbox_pool_t *pool, uint32_t count, uint32_t radix, prng_state_t *prng)
+generate_sbox_pool(sbox_pool_t *pool, uint32_t count, uint32_t radix, prng_state_t *prng,
+                   uint32_t directions, fast_arena_t *arena)
 {
-    if (!pool || count == 0 || radix < 4 || radix > FAST_MAX_RADIX || !prng) {
+    if (!pool || count == 0 || radix < 4 || radix > FAST_MAX_RADIX16 || !prng ||
+        directions == 0 || (directions & ~(FAST_SBOX_FORWARD | FAST_SBOX_INVERSE)) != 0) {
         return -1;
     }
 
-    pool->sboxes = calloc(count, sizeof(sbox_t));
-    if (!pool->sboxes) {
+    memset(pool, 0, sizeof(*pool));
+    pool->count       = count;
+    pool->radix       = radix;
+    pool->sbox_stride = sbox_stride(radix);
+    pool->padded      = radix <= FAST_PADDED_MAX_RADIX;
+    pool->arena       = arena;
+
+    // Without forward tables, each permutation only lives in the scratch table until inverted
+    const bool   forward = (directions & FAST_SBOX_FORWARD) != 0;
+    const bool   inverse = (directions & FAST_SBOX_INVERSE) != 0;
+    const size_t width   = radix > FAST_MAX_RADIX ? sizeof(uint16_t) : sizeof(uint8_t);
+    uint8_t     *scratch = forward ? NULL : pool_alloc(pool, pool->sbox_stride);
+
+    pool->sboxes = pool_alloc(pool, (size_t) count * sizeof(sbox_t));
+    if (!pool->sboxes || (!forward && !scratch) ||
+        (forward && !(pool->perm_slab = alloc_slab(pool))) ||
+        (inverse && !(pool->inv_slab = alloc_slab(pool)))) {
+        pool_free(pool, scratch);
+        free_sbox_pool(pool);
         return -1;
     }
 
-    pool->count = count;
-    pool->radix = radix;
-
     for (uint32_t i = 0; i < count; i++) {
-        if (generate_sbox(&pool->sboxes[i], radix, prng) != 0) {
-            for (uint32_t j = 0; j < i; j++) {
-                free(pool->sboxes[j].perm);
-                free(pool->sboxes[j].inv);
-            }
-            free(pool->sboxes);
-            pool->sboxes = NULL;
-            return -1;
+        uint8_t *perm = forward ? pool->perm_slab + (size_t) i * pool->sbox_stride : scratch;
+        shuffle_table(perm, radix, width, prng);
+        if (inverse) {
+            invert_sbox(perm, pool->inv_slab + (size_t) i * pool->sbox_stride, radix);
         }
     }
+    if (scratch) {
+        memset(scratch, 0, pool->sbox_stride);
+        pool_free(pool, scratch);
+    }
+    link_sboxes(pool);
+
+    if (radix <= FAST_FUSED_MAX_RADIX &&
+        ((forward && build_fused_enc(pool) != 0) || (inverse && build_fused_dec(pool) != 0))) {
+        free_sbox_pool(pool);
+        return -1;
+    }
 
     return 0;
 }
 
-void
-free_sbox_pool(sbox_pool_t *pool)
+int
+build_inverse_tables(sbox_pool_t *pool)
 {
     if (!pool || !pool->sboxes) {
-        return;
+        return -1;
+    }
+    if (pool->inv_slab) {
+        return 0;
+    }
+    if (!pool->perm_slab || !(pool->inv_slab = alloc_slab(pool))) {
+        return -1;
     }
 
     for (uint32_t i = 0; i < pool->count; i++) {
-        if (pool->sboxes[i].perm) {
-            free(pool->sboxes[i].perm);
-        }
-        if (pool->sboxes[i].inv) {
-            free(pool->sboxes[i].inv);
-        }
+        const size_t at = (size_t) i * pool->sbox_stride;
+        invert_sbox(pool->perm_slab + at, pool->inv_slab + at, pool->radix);
+    }
+    link_sboxes(pool);
+
+    if (pool->radix <= FAST_FUSED_MAX_RADIX && build_fused_dec(pool) != 0) {
+        pool_free(pool, pool->inv_slab);
+        pool->inv_slab = NULL;
+        link_sboxes(pool);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Pool block holding a copy of another one
+static uint8_t *
+copy_block(const sbox_pool_t *pool, const uint8_t *src, size_t bytes)
+{
+    uint8_t *block = pool_alloc(pool, bytes);
+    if (block) {
+        memcpy(block, src, bytes);
+    }
+    return block;
+}
+
+// Copy of a pool with tables of its own, for the directions it has built. With an arena, the copy
+// takes no more of it than sbox_pool_size() for those directions.
+int
+copy_sbox_pool(sbox_pool_t *dst, const sbox_pool_t *src, fast_arena_t *arena)
+{
+    if (!dst || !src || !src->sboxes) {
+        return -1;
+    }
+
+    const size_t slab  = (size_t) src->count * src->sbox_stride;
+    const size_t table = (size_t) src->radix << FAST_FUSED_SHIFT;
+
+    memset(dst, 0, sizeof(*dst));
+    dst->count       = src->count;
+    dst->radix       = src->radix;
+    dst->sbox_stride = src->sbox_stride;
+    dst->padded      = src->padded;
+    dst->arena       = arena;
+
+    dst->sboxes = pool_alloc(dst, (size_t) src->count * sizeof(sbox_t));
+    if (!dst->sboxes ||
+        (src->perm_slab && !(dst->perm_slab = copy_block(dst, src->perm_slab, slab))) ||
+        (src->inv_slab && !(dst->inv_slab = copy_block(dst, src->inv_slab, slab))) ||
+        (src->fused_enc &&
+         !(dst->fused_enc = copy_block(dst, src->fused_enc, (size_t) src->count * 2 * table))) ||
+        (src->fused_dec &&
+         !(dst->fused_dec = copy_block(dst, src->fused_dec, (size_t) src->count * table)))) {
+        free_sbox_pool(dst);
+        return -1;
+    }
+    link_sboxes(dst);
+
+    return 0;
+}
+
+// Arena bytes of a pool with these directions, counting the inverse tables of a pool generated
+// forward only and inverted later
+size_t
+sbox_pool_size(uint32_t count, uint32_t radix, uint32_t directions)
+{
+    const size_t slab  = arena_bytes((size_t) count * sbox_stride(radix));
+    const size_t table = (size_t) radix << FAST_FUSED_SHIFT;
+    size_t       bytes = arena_bytes((size_t) count * sizeof(sbox_t));
+
+    if (directions & FAST_SBOX_FORWARD) {
+        bytes += slab;
+        bytes += fused_enc_fits(count, radix) ? arena_bytes((size_t) count * 2 * table) : 0;
+    } else {
+        bytes += arena_bytes(sbox_stride(radix)); // Scratch permutation
+    }
+    if (directions & FAST_SBOX_INVERSE) {
+        bytes += slab;
+        bytes += radix <= FAST_FUSED_MAX_RADIX ? arena_bytes((size_t) count * table) : 0;
+    }
+    return bytes;
+}
+
+void
+free_sbox_pool(sbox_pool_t *pool)
+{
+    if (!pool || !pool->sboxes) {
+        return;
     }
 
-    free(pool->sboxes);
-    pool->sboxes = NULL;
-    pool->count  = 0;
+    // The S-boxes point into the slabs
+    pool_free(pool, pool->sboxes);
+    pool_free(pool, pool->perm_slab);
+    pool_free(pool, pool->inv_slab);
+    pool_free(pool, pool->fused_enc);
+    pool_free(pool, pool->fused_dec);
+    pool->sboxes    = NULL;
+    pool->perm_slab = NULL;
+    pool->inv_slab  = NULL;
+    pool->fused_enc = NULL;
+    pool->fused_dec = NULL;
+    pool->count     = 0;
 }
 
 void
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200112L // setenv
 #include "fast.h"
 #include "fast_internal.h" // For testing internal functions
 #include <assert.h>
@@ -51,6 +52,34 @@ test_sbox_generation()
 
     free(sbox.perm);
     prng_cleanup(&prng);
+
+    // Pools keep the tables of each direction in one aligned slab, at the documented strides
+    const uint8_t  material[FAST_DERIVED_KEY_SIZE] = { 0x5A };
+    const uint32_t radices[]                       = { 10, 100, 256, 1000 };
+    const size_t   strides[]                       = { 16, 128, 256, 2048 };
+    for (size_t r = 0; r < sizeof(radices) / sizeof(radices[0]); r++) {
+        sbox_pool_t pool;
+        assert(fast_generate_sbox_pool(&pool, 8, radices[r], material, sizeof(material),
+                                       FAST_SBOX_FORWARD | FAST_SBOX_INVERSE, NULL) == 0);
+        assert(((uintptr_t) pool.perm_slab % FAST_CACHE_LINE) == 0);
+        assert(((uintptr_t) pool.inv_slab % FAST_CACHE_LINE) == 0);
+        assert(pool.sbox_stride == strides[r]);
+        for (uint32_t i = 0; i < pool.count; i++) {
+            const sbox_t *box = &pool.sboxes[i];
+            if (radices[r] > FAST_MAX_RADIX) {
+                assert((const uint8_t *) box->perm16 == pool_table(&pool, i, false));
+                assert((const uint8_t *) box->inv16 == pool_table(&pool, i, true));
+                assert(box->inv16[box->perm16[radices[r] - 1]] == radices[r] - 1);
+            } else {
+                assert(box->perm == pool_table(&pool, i, false));
+                assert(box->inv == pool_table(&pool, i, true));
+                assert(box->inv[box->perm[radices[r] - 1]] == radices[r] - 1);
+            }
+        }
+        assert(pool.padded == (radices[r] <= FAST_PADDED_MAX_RADIX));
+        free_sbox_pool(&pool);
+    }
+    printf("✓ Pool slab layout\n");
 }
 
 void
@@ -139,6 +168,89 @@ test_different_inputs()
     fast_cleanup(ctx);
 }
 
+static void
+test_prf()
+{
+    printf("\n=== Testing CMAC PRF ===\n");
+
+    // RFC 4493, section 4
+    const uint8_t key[FAST_AES_KEY_SIZE] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+                                             0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+    const uint8_t message[64] = { 0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E,
+                                  0x11, 0x73, 0x93, 0x17, 0x2A, 0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03,
+                                  0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51, 0x30,
+                                  0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11, 0xE5, 0xFB, 0xC1, 0x19,
+                                  0x1A, 0x0A, 0x52, 0xEF, 0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B,
+                                  0x17, 0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10 };
+    const size_t  lengths[] = { 0, 16, 40, 64 };
+    const uint8_t tags[][FAST_AES_BLOCK_SIZE] = {
+        { 0xBB, 0x1D, 0x69, 0x29, 0xE9, 0x59, 0x37, 0x28, 0x7F, 0xA3, 0x7D, 0x12, 0x9B, 0x75, 0x67,
+          0x46 },
+        { 0x07, 0x0A, 0x16, 0xB4, 0x6B, 0x4D, 0x41, 0x44, 0xF7, 0x9B, 0xDD, 0x9D, 0xD0, 0x4A, 0x28,
+          0x7C },
+        { 0xDF, 0xA6, 0x67, 0x47, 0xDE, 0x9A, 0xE6, 0x30, 0x30, 0xCA, 0x32, 0x61, 0x14, 0x97, 0xC8,
+          0x27 },
+        { 0x51, 0xF0, 0xBE, 0xBF, 0x7E, 0x3B, 0x9D, 0x92, 0xFC, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3C,
+          0xFE },
+    };
+
+    prf_t prf;
+    assert(prf_init(&prf, key) == 0);
+    for (size_t t = 0; t < sizeof(lengths) / sizeof(lengths[0]); t++) {
+        // Fed in uneven pieces, so that blocks straddle updates
+        cmac_state_t state;
+        uint8_t      tag[FAST_AES_BLOCK_SIZE];
+        cmac_begin(&state);
+        for (size_t at = 0; at < lengths[t]; at += 7) {
+            const size_t piece = lengths[t] - at < 7 ? lengths[t] - at : 7;
+            assert(cmac_update(&prf, &state, message + at, piece) == 0);
+        }
+        assert(cmac_final(&prf, &state, tag) == 0);
+        assert(memcmp(tag, tags[t], sizeof(tag)) == 0);
+    }
+    printf("✓ CMAC matches the RFC 4493 test vectors\n");
+
+    // Block i of the output is the MAC of i, the part count, then each part's length and bytes
+    const uint8_t a[]     = "abc";
+    const uint8_t b[]     = "0123456789abcdefXYZ";
+    prf_part_t    parts[] = { { a, 3 }, { NULL, 0 }, { b, 19 } };
+    uint8_t       encoded[4 + 4 + (4 + 3) + 4 + (4 + 19)];
+    uint8_t       out[40], expected[48];
+    size_t        at = 8;
+    write_u32_be(3, encoded + 4);
+    for (size_t i = 0; i < 3; i++) {
+        write_u32_be((uint32_t) parts[i].len, encoded + at);
+        if (parts[i].len > 0) {
+            memcpy(encoded + at + 4, parts[i].data, parts[i].len);
+        }
+        at += 4 + parts[i].len;
+    }
+    for (uint32_t counter = 0; counter < 3; counter++) {
+        cmac_state_t state;
+        write_u32_be(counter, encoded);
+        cmac_begin(&state);
+        assert(cmac_update(&prf, &state, encoded, sizeof(encoded)) == 0);
+        assert(cmac_final(&prf, &state, expected + counter * FAST_AES_BLOCK_SIZE) == 0);
+    }
+    assert(prf_derive(&prf, parts, 3, out, sizeof(out)) == 0);
+    assert(memcmp(out, expected, sizeof(out)) == 0);
+    printf("✓ PRF streams its encoded parts through CMAC, block by block\n");
+
+    // Resuming from the state after the first parts gives the same output, wherever the split
+    for (size_t split = 0; split <= 3; split++) {
+        cmac_state_t states[3];
+        assert(prf_prefix(&prf, 3, parts, split, states, 3) == 0);
+        memset(out, 0, sizeof(out));
+        assert(prf_finish(&prf, states, 3, parts + split, 3 - split, out, sizeof(out)) == 0);
+        assert(memcmp(out, expected, sizeof(out)) == 0);
+
+        // No more output than the states prepared
+        assert(prf_finish(&prf, states, 2, parts + split, 3 - split, out, sizeof(out)) == -1);
+    }
+    prf_cleanup(&prf);
+    printf("✓ PRF output resumed after a common prefix matches\n");
+}
+
 void
 test_prng_determinism()
 {
@@ -170,6 +282,744 @@ test_prng_determinism()
 
     prng_cleanup(&prng1);
     prng_cleanup(&prng2);
+
+    // The keystream is AES of the nonce plus one, two, ... as 128-bit big-endian integers, across
+    // refills and carries alike
+    uint8_t counter[FAST_AES_BLOCK_SIZE];
+    memset(counter, 0xFF, sizeof(counter));
+    counter[0] = 0x42;
+    counter[FAST_AES_BLOCK_SIZE - 1] = 0xF0;
+    assert(prng_init(&prng1, key, counter) == 0);
+
+    const size_t    stream_len = 3 * FAST_PRNG_BUFFER_SIZE + 3 * FAST_AES_BLOCK_SIZE;
+    uint8_t        *stream     = malloc(stream_len);
+    uint8_t        *expected   = malloc(stream_len);
+    EVP_CIPHER_CTX *aes        = EVP_CIPHER_CTX_new();
+    int             out_len    = 0;
+    assert(stream && expected && aes);
+    assert(EVP_EncryptInit_ex(aes, EVP_aes_128_ecb(), NULL, key, NULL) == 1);
+    EVP_CIPHER_CTX_set_padding(aes, 0);
+    for (size_t at = 0; at < stream_len; at += FAST_AES_BLOCK_SIZE) {
+        for (int i = FAST_AES_BLOCK_SIZE - 1; i >= 0 && ++counter[i] == 0; i--) {
+        }
+        assert(EVP_EncryptUpdate(aes, expected + at, &out_len, counter, FAST_AES_BLOCK_SIZE) == 1);
+    }
+    // Odd-sized reads, so that some straddle a refill
+    for (size_t at = 0; at < stream_len; at += 13) {
+        prng_get_bytes(&prng1, stream + at, stream_len - at < 13 ? stream_len - at : 13);
+    }
+    assert(memcmp(stream, expected, stream_len) == 0);
+    printf("✓ PRNG keystream is AES-CTR from the nonce plus one\n");
+
+    EVP_CIPHER_CTX_free(aes);
+    free(stream);
+    free(expected);
+    prng_cleanup(&prng1);
+
+    // Batched draws match one prng_uniform() call each: power-of-two bounds, a bound rejecting
+    // about half the words, falling bounds as in a shuffle, and a keystream read off word alignment
+    const struct {
+        uint32_t bound;
+        uint32_t step;
+        uint32_t count;
+        uint32_t skew;
+    } batches[] = {
+        { 256, 0, 3000, 0 },
+        { 1, 0, 9, 0 },
+        { 0x80000001U, 0, 2500, 0 },
+        { 65536, 1, 65535, 0 },
+        { 10, 0, 1500, 3 },
+        { 0x80000001U, 0x10000000U, 8, 0 },
+        { 1U << 31, 0, 1200, 2 },
+        { 37, 3, 12, 1 },
+    };
+    uint32_t *batch = malloc(65535 * sizeof(uint32_t));
+    assert(batch);
+    for (size_t t = 0; t < sizeof(batches) / sizeof(batches[0]); t++) {
+        uint8_t skew[3];
+        assert(prng_init(&prng1, key, nonce) == 0);
+        assert(prng_init(&prng2, key, nonce) == 0);
+        prng_get_bytes(&prng1, skew, batches[t].skew);
+        prng_get_bytes(&prng2, skew, batches[t].skew);
+
+        // Twice, so that the second batch starts wherever the first left the buffer
+        for (int pass = 0; pass < 2; pass++) {
+            prng_uniform_batch(&prng1, batches[t].bound, batches[t].step, batch, batches[t].count);
+            for (uint32_t i = 0; i < batches[t].count; i++) {
+                assert(batch[i] == prng_uniform(&prng2, batches[t].bound - i * batches[t].step));
+            }
+        }
+        assert(prng_next_u32(&prng1) == prng_next_u32(&prng2));
+        prng_cleanup(&prng1);
+        prng_cleanup(&prng2);
+    }
+    free(batch);
+    printf("✓ Batched PRNG draws match single draws\n");
+}
+
+void
+test_batch_matches_single()
+{
+    printf("\n=== Testing Batch Encryption ===\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0x10, 0x32, 0x54, 0x76, 0x98, 0xBA, 0xDC, 0xFE,
+                                       0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF };
+
+    // Radices on both sides of the 16, 64 and 128 vector kernel limits, and a shape-specialized
+    // one; 37 words leave a partial group for every kernel
+    const uint32_t shapes[][2] = { { 10, 16 }, { 10, 7 },   { 16, 8 },  { 36, 12 },
+                                   { 64, 10 }, { 100, 20 }, { 200, 9 }, { 256, 32 } };
+    const size_t   count       = 37;
+
+    srand(1234);
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        fast_params_t params;
+        assert(calculate_recommended_params(&params, shapes[s][0], shapes[s][1]) == 0);
+
+        fast_context_t *ctx;
+        assert(fast_init(&ctx, &params, key) == 0);
+
+        const size_t ell    = params.word_length;
+        uint8_t     *input  = malloc(count * ell);
+        uint8_t     *batch  = malloc(count * ell);
+        uint8_t     *single = malloc(count * ell);
+        assert(input && batch && single);
+
+        for (size_t i = 0; i < count * ell; i++) {
+            input[i] = (uint8_t) (rand() % params.radix);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            assert(fast_encrypt(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input + i * ell,
+                                single + i * ell, ell) == 0);
+        }
+        assert(fast_encrypt_batch(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, batch, ell,
+                                  count) == 0);
+        assert(memcmp(batch, single, count * ell) == 0);
+
+        // In place, back to the plaintexts
+        assert(fast_decrypt_batch(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, batch, batch, ell,
+                                  count) == 0);
+        assert(memcmp(batch, input, count * ell) == 0);
+
+        // A single bad symbol rejects the whole batch
+        if (params.radix < 256) {
+            input[count * ell - 1] = (uint8_t) params.radix;
+            assert(fast_encrypt_batch(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, batch, ell,
+                                      count) == -1);
+        }
+        assert(fast_encrypt_batch(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, batch, ell - 1,
+                                  count) == -1);
+
+        printf("✓ radix %u, length %u: batch matches single-word encryption\n", params.radix,
+               params.word_length);
+
+        free(input);
+        free(batch);
+        free(single);
+        fast_cleanup(ctx);
+    }
+}
+
+void
+test_cpu_tiers()
+{
+    printf("\n=== Testing CPU Tiers ===\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0x3C, 0x4F, 0xCF, 0x09, 0x88, 0x15, 0xF7, 0xAB,
+                                       0xA6, 0xD2, 0xAE, 0x28, 0x16, 0x15, 0x7E, 0x2B };
+
+    const fast_cpu_tier_t detected = fast_cpu_tier();
+    printf("Tier in effect: %s\n", fast_cpu_tier_name(detected));
+
+    assert(fast_set_cpu_tier((fast_cpu_tier_t) 99) == -1);
+    assert(fast_cpu_tier() == detected);
+
+    // Every tier up to the detected one must give the scalar results
+    const uint32_t shapes[][2] = { { 10, 16 }, { 100, 20 }, { 256, 16 } };
+    const size_t   count       = 70;
+
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        fast_params_t params;
+        assert(calculate_recommended_params(&params, shapes[s][0], shapes[s][1]) == 0);
+
+        const size_t ell       = params.word_length;
+        uint8_t     *input     = malloc(count * ell);
+        uint8_t     *reference = malloc(count * ell);
+        uint8_t     *output    = malloc(count * ell);
+        assert(input && reference && output);
+
+        for (size_t i = 0; i < count * ell; i++) {
+            input[i] = (uint8_t) ((i * 7 + s) % params.radix);
+        }
+
+        for (int tier = FAST_CPU_TIER_SCALAR; tier <= (int) detected; tier++) {
+            assert(fast_set_cpu_tier((fast_cpu_tier_t) tier) == 0);
+            assert(fast_cpu_tier() == (fast_cpu_tier_t) tier);
+
+            fast_context_t *ctx;
+            assert(fast_init(&ctx, &params, key) == 0);
+            assert(fast_encrypt_batch(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, output, ell,
+                                      count) == 0);
+            if (tier == FAST_CPU_TIER_SCALAR) {
+                memcpy(reference, output, count * ell);
+            }
+            assert(memcmp(output, reference, count * ell) == 0);
+            assert(fast_decrypt_batch(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, output, output, ell,
+                                      count) == 0);
+            assert(memcmp(output, input, count * ell) == 0);
+            fast_cleanup(ctx);
+        }
+        printf("✓ radix %u: all tiers up to %s agree\n", params.radix,
+               fast_cpu_tier_name(detected));
+
+        free(input);
+        free(reference);
+        free(output);
+    }
+
+    assert(fast_set_cpu_tier(FAST_CPU_TIER_AUTO) == 0);
+    assert(fast_cpu_tier() == detected);
+}
+
+static void
+test_jit()
+{
+    printf("\n=== Testing JIT ===\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0x3C, 0x4F, 0xCF, 0x09, 0x88, 0x15, 0xF7, 0xAB,
+                                       0xA6, 0xD2, 0xAE, 0x28, 0x16, 0x15, 0x7E, 0x2B };
+
+    fast_params_t   params;
+    fast_context_t *ctx = NULL;
+    assert(calculate_recommended_params(&params, 10, 16) == 0);
+    assert(fast_init_ex(&ctx, &params, key, 1U << 31) == -1);
+    assert(ctx == NULL);
+
+    // Power-of-two, generic and radix 256 arithmetic, and a word without the w branch
+    const uint32_t shapes[][2] = { { 10, 16 }, { 16, 8 }, { 36, 2 }, { 100, 20 }, { 256, 16 } };
+    const uint8_t  tweaks[][4] = { { 1, 2, 3, 4 }, { 5, 6, 7, 8 } };
+
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        assert(calculate_recommended_params(&params, shapes[s][0], shapes[s][1]) == 0);
+
+        fast_context_t *plain, *jit;
+        assert(fast_init(&plain, &params, key) == 0);
+        assert(fast_init_ex(&jit, &params, key, FAST_INIT_JIT) == 0);
+
+        uint8_t input[32], expected[32], output[32];
+        for (uint32_t i = 0; i < 10; i++) {
+            // Alternate tweaks so that the JIT code is rebuilt between words
+            const uint8_t *tweak = tweaks[i % 2];
+            for (uint32_t j = 0; j < params.word_length; j++) {
+                input[j] = (uint8_t) ((i * 31 + j * 7 + s) % params.radix);
+            }
+            assert(fast_encrypt(plain, tweak, 4, input, expected, params.word_length) == 0);
+            assert(fast_encrypt(jit, tweak, 4, input, output, params.word_length) == 0);
+            assert(memcmp(output, expected, params.word_length) == 0);
+            assert(fast_decrypt(jit, tweak, 4, output, output, params.word_length) == 0);
+            assert(memcmp(output, input, params.word_length) == 0);
+        }
+        printf("✓ radix %u, length %u: JIT matches the kernels\n", params.radix,
+               params.word_length);
+
+        fast_cleanup(plain);
+        fast_cleanup(jit);
+    }
+}
+
+static void
+test_autotune()
+{
+    printf("\n=== Testing Autotuner ===\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0x3C, 0x4F, 0xCF, 0x09, 0x88, 0x15, 0xF7, 0xAB,
+                                       0xA6, 0xD2, 0xAE, 0x28, 0x16, 0x15, 0x7E, 0x2B };
+
+    const char *cache = "test_fast_tune.cache";
+    remove(cache);
+    assert(setenv("FAST_TUNE_CACHE", cache, 1) == 0);
+
+    const uint32_t shapes[][2] = { { 10, 16 }, { 256, 16 } };
+
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        fast_params_t params;
+        assert(calculate_recommended_params(&params, shapes[s][0], shapes[s][1]) == 0);
+
+        fast_context_t    *plain, *tuned, *cached;
+        fast_kernel_info_t plain_info, tuned_info, cached_info;
+        assert(fast_init(&plain, &params, key) == 0);
+        assert(fast_init_ex(&tuned, &params, key, FAST_INIT_AUTOTUNE | FAST_INIT_JIT) == 0);
+        assert(fast_init_ex(&cached, &params, key, FAST_INIT_AUTOTUNE | FAST_INIT_JIT) == 0);
+        assert(fast_get_kernel_info(plain, &plain_info) == 0 && !plain_info.autotuned);
+        assert(fast_get_kernel_info(tuned, &tuned_info) == 0 && tuned_info.autotuned);
+        assert(fast_get_kernel_info(cached, &cached_info) == 0 && cached_info.autotuned);
+
+        // The second context reads the first one's choices back from the cache
+        assert(strcmp(tuned_info.encrypt, cached_info.encrypt) == 0);
+        assert(strcmp(tuned_info.decrypt, cached_info.decrypt) == 0);
+        assert(strcmp(tuned_info.encrypt_batch, cached_info.encrypt_batch) == 0);
+        assert(strcmp(tuned_info.decrypt_batch, cached_info.decrypt_batch) == 0);
+        printf("✓ radix %u: encrypt %s, decrypt %s, batches %s / %s\n", params.radix,
+               tuned_info.encrypt, tuned_info.decrypt, tuned_info.encrypt_batch,
+               tuned_info.decrypt_batch);
+
+        uint8_t input[32 * 16], expected[32 * 16], output[32 * 16];
+        for (size_t i = 0; i < sizeof(input); i++) {
+            input[i] = (uint8_t) ((i * 13 + s) % params.radix);
+        }
+        assert(fast_encrypt_batch(plain, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, expected, 16,
+                                  32) == 0);
+        assert(fast_encrypt_batch(tuned, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, output, 16,
+                                  32) == 0);
+        assert(memcmp(output, expected, sizeof(output)) == 0);
+        assert(fast_encrypt(tuned, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, output, 16) == 0);
+        assert(memcmp(output, expected, 16) == 0);
+        assert(fast_decrypt(tuned, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, output, output, 16) == 0);
+        assert(memcmp(output, input, 16) == 0);
+        assert(fast_decrypt_batch(cached, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, expected, output, 16,
+                                  32) == 0);
+        assert(memcmp(output, input, sizeof(output)) == 0);
+
+        fast_cleanup(plain);
+        fast_cleanup(tuned);
+        fast_cleanup(cached);
+    }
+
+    // Hand-written entries under the key tune.c looks up: one naming existing kernels is used as
+    // is, and one naming kernels that do not exist is ignored. A context only appends its choices
+    // to the cache when it found none there.
+    fast_params_t params;
+    char          model[FAST_CPU_MODEL_SIZE];
+    char          line[512];
+    assert(calculate_recommended_params(&params, 10, 16) == 0);
+    fast_cpu_model(model, sizeof(model));
+
+    const char *names[] = { "generic", "bogus" };
+    for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+        const bool valid = strcmp(names[n], "bogus") != 0;
+        FILE      *file  = fopen(cache, "w");
+        assert(file);
+        fprintf(file, "%s\t%u %u %u %u %u %u %s nojit both\t%s %s %s %s\n", model, params.radix,
+                params.word_length, params.branch_dist1, params.branch_dist2, params.num_layers,
+                params.sbox_count, fast_cpu_tier_name(fast_cpu_tier()), names[n], names[n],
+                names[n], names[n]);
+        fclose(file);
+
+        fast_context_t    *ctx;
+        fast_kernel_info_t info;
+        assert(fast_init_ex(&ctx, &params, key, FAST_INIT_AUTOTUNE) == 0);
+        assert(fast_get_kernel_info(ctx, &info) == 0 && info.autotuned);
+        if (valid) {
+            assert(strcmp(info.encrypt, names[n]) == 0 && strcmp(info.decrypt, names[n]) == 0);
+            assert(strcmp(info.encrypt_batch, names[n]) == 0);
+            assert(strcmp(info.decrypt_batch, names[n]) == 0);
+        } else {
+            assert(strcmp(info.encrypt, "bogus") != 0 && strcmp(info.decrypt_batch, "bogus") != 0);
+        }
+        fast_cleanup(ctx);
+
+        size_t lines = 0;
+        file         = fopen(cache, "r");
+        assert(file);
+        while (fgets(line, sizeof(line), file)) {
+            lines++;
+        }
+        fclose(file);
+        assert(lines == (valid ? 1U : 2U));
+    }
+    printf("✓ Valid cache entries are used\n");
+    printf("✓ Invalid cache entries are ignored\n");
+
+    assert(unsetenv("FAST_TUNE_CACHE") == 0);
+    remove(cache);
+}
+
+static void
+test_long_messages()
+{
+    printf("\n=== Testing Long Messages ===\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0x3C, 0x4F, 0xCF, 0x09, 0x88, 0x15, 0xF7, 0xAB,
+                                       0xA6, 0xD2, 0xAE, 0x28, 0x16, 0x15, 0x7E, 0x2B };
+
+    fast_params_t   params;
+    fast_context_t *ctx;
+    assert(calculate_recommended_params(&params, 10, 16) == 0);
+    assert(fast_init(&ctx, &params, key) == 0);
+
+    enum { MAX_LENGTH = 200 };
+    uint8_t input[MAX_LENGTH], output[MAX_LENGTH], other[MAX_LENGTH];
+    for (size_t i = 0; i < MAX_LENGTH; i++) {
+        input[i] = (uint8_t) ((i * 7 + 3) % params.radix);
+    }
+
+    // Too short for a block
+    assert(fast_encrypt_long(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, output, 15) == -1);
+
+    // Single block, whole blocks, and a last block overlapping the previous one
+    const size_t lengths[] = { 16, 17, 31, 32, 33, 48, 100, MAX_LENGTH };
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        const size_t length = lengths[l];
+        assert(fast_encrypt_long(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, output, length) ==
+               0);
+        assert(memcmp(output, input, length) != 0);
+        for (size_t i = 0; i < length; i++) {
+            assert(output[i] < params.radix);
+        }
+
+        // In place, and interleaved with single-word calls on the same tweak
+        memcpy(other, output, length);
+        assert(fast_encrypt(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, other, 16) == 0);
+        memcpy(other, output, length);
+        assert(fast_decrypt_long(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, other, other, length) ==
+               0);
+        assert(memcmp(other, input, length) == 0);
+    }
+    printf("✓ Round trip for lengths 16 to %d\n", MAX_LENGTH);
+
+    // The first block is not fast_encrypt() of the same tweak
+    assert(fast_encrypt_long(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, output, 16) == 0);
+    assert(fast_encrypt(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, other, 16) == 0);
+    assert(memcmp(output, other, 16) != 0);
+
+    // A change in the first, a middle or the last block changes every block
+    const size_t length    = 100;
+    const size_t changes[] = { 0, 40, length - 1 };
+    assert(fast_encrypt_long(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, output, length) == 0);
+    for (size_t c = 0; c < sizeof(changes) / sizeof(changes[0]); c++) {
+        const size_t at = changes[c];
+        input[at]       = (uint8_t) ((input[at] + 1) % params.radix);
+        assert(fast_encrypt_long(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, other, length) == 0);
+        input[at] = (uint8_t) ((input[at] + params.radix - 1) % params.radix);
+        for (size_t b = 0; b < length; b += 16) {
+            const size_t start = b + 16 > length ? length - 16 : b;
+            assert(memcmp(output + start, other + start, 16) != 0);
+        }
+    }
+    printf("✓ Changes propagate to every block\n");
+
+    // Length and tweak are both bound to every block
+    assert(fast_encrypt_long(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, input, other, length - 1) == 0);
+    assert(memcmp(output, other, 16) != 0);
+    assert(fast_encrypt_long(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN - 1, input, other, length) == 0);
+    assert(memcmp(output, other, 16) != 0);
+    printf("✓ Length and tweak change every block\n");
+
+    fast_cleanup(ctx);
+}
+
+static void
+test_wide_symbols()
+{
+    printf("\n=== Testing Wide Symbols ===\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+                                       0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+
+    const uint32_t radices[] = { 257, 1000, 10000, FAST_MAX_RADIX16 };
+    for (size_t r = 0; r < sizeof(radices) / sizeof(radices[0]); r++) {
+        fast_params_t   params;
+        fast_context_t *ctx;
+        assert(calculate_recommended_params(&params, radices[r], 8) == 0);
+        assert(fast_init(&ctx, &params, key) == 0);
+
+        uint16_t plaintext[8], ciphertext[8], decrypted[8];
+        for (size_t i = 0; i < 8; i++) {
+            plaintext[i] = (uint16_t) ((i * 4099 + 1) % params.radix);
+        }
+        plaintext[7] = (uint16_t) (params.radix - 1);
+
+        assert(fast_encrypt16(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, plaintext, ciphertext, 8) ==
+               0);
+        assert(memcmp(plaintext, ciphertext, sizeof(plaintext)) != 0);
+        for (size_t i = 0; i < 8; i++) {
+            assert(ciphertext[i] < params.radix);
+        }
+        assert(fast_decrypt16(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, ciphertext, decrypted, 8) ==
+               0);
+        assert(memcmp(plaintext, decrypted, sizeof(plaintext)) == 0);
+
+        // Byte entry points do not take wide symbols
+        uint8_t bytes[8] = { 0 };
+        assert(fast_encrypt(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, bytes, bytes, 8) == -1);
+
+        if (params.radix < 65536) {
+            plaintext[0] = (uint16_t) params.radix;
+            assert(fast_encrypt16(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, plaintext, ciphertext,
+                                  8) == -1);
+        }
+
+        fast_kernel_info_t info;
+        assert(fast_get_kernel_info(ctx, &info) == 0);
+        assert(strcmp(info.encrypt, "wide") == 0 && strcmp(info.decrypt_batch, "wide") == 0);
+
+        fast_cleanup(ctx);
+    }
+    printf("✓ Round trip for radices 257 to %u\n", FAST_MAX_RADIX16);
+
+    // The 16-bit entry points do not take byte contexts, nor radices past 16 bits
+    fast_params_t   params;
+    fast_context_t *ctx;
+    uint16_t        word[8] = { 0 };
+    assert(calculate_recommended_params(&params, 256, 8) == 0);
+    assert(fast_init(&ctx, &params, key) == 0);
+    assert(fast_encrypt16(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, word, word, 8) == -1);
+    assert(fast_decrypt16(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, word, word, 8) == -1);
+    fast_cleanup(ctx);
+    assert(calculate_recommended_params(&params, FAST_MAX_RADIX16 + 1, 8) == -1);
+    params.radix = FAST_MAX_RADIX16 + 1;
+    assert(fast_init(&ctx, &params, key) == -1);
+    printf("✓ Symbol width checked\n");
+}
+
+// One 12-symbol word through the byte or the 16-bit entry point, as the radix requires
+static int
+crypt_word(fast_context_t *ctx, uint32_t radix, bool decrypt, const uint16_t *in, uint16_t *out)
+{
+    if (radix > FAST_MAX_RADIX) {
+        return decrypt ? fast_decrypt16(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, in, out, 12)
+                       : fast_encrypt16(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, in, out, 12);
+    }
+
+    uint8_t in8[12], out8[12];
+    for (size_t i = 0; i < 12; i++) {
+        in8[i] = (uint8_t) in[i];
+    }
+    const int status = decrypt ? fast_decrypt(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, in8, out8, 12)
+                               : fast_encrypt(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, in8, out8, 12);
+    for (size_t i = 0; i < 12; i++) {
+        out[i] = out8[i];
+    }
+    return status;
+}
+
+static void
+test_directions()
+{
+    printf("\n=== Testing Single-Direction Contexts ===\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0x10, 0x32, 0x54, 0x76, 0x98, 0xBA, 0xDC, 0xFE,
+                                       0xEF, 0xCD, 0xAB, 0x89, 0x67, 0x45, 0x23, 0x01 };
+
+    const uint32_t radices[] = { 10, 100, 256, 1000 };
+    for (size_t r = 0; r < sizeof(radices) / sizeof(radices[0]); r++) {
+        const uint32_t  radix = radices[r];
+        fast_params_t   params;
+        fast_context_t *both, *enc_only, *dec_only;
+        memset(&params, 0, sizeof(params));
+        assert(calculate_recommended_params(&params, radix, 12) == 0);
+        assert(fast_init(&both, &params, key) == 0);
+        assert(fast_init_ex(&enc_only, &params, key, FAST_INIT_ENCRYPT_ONLY) == 0);
+        assert(fast_init_ex(&dec_only, &params, key, FAST_INIT_DECRYPT_ONLY | FAST_INIT_JIT) == 0);
+
+        uint16_t pt[12], ct[12], out[12];
+        for (size_t i = 0; i < 12; i++) {
+            pt[i] = (uint16_t) ((i * 37 + 5) % radix);
+        }
+
+        // Same ciphertexts whichever directions a context was built for
+        assert(crypt_word(both, radix, false, pt, ct) == 0);
+        assert(crypt_word(enc_only, radix, false, pt, out) == 0);
+        assert(memcmp(ct, out, sizeof(ct)) == 0);
+        assert(crypt_word(dec_only, radix, true, ct, out) == 0);
+        assert(memcmp(pt, out, sizeof(pt)) == 0);
+
+        // The other direction is refused
+        assert(crypt_word(enc_only, radix, true, ct, out) == -1);
+        assert(crypt_word(dec_only, radix, false, pt, out) == -1);
+
+        // A two-way context builds its inverse tables on its first decryption, with the program of
+        // the current tweak already compiled
+        assert(crypt_word(both, radix, true, ct, out) == 0);
+        assert(memcmp(pt, out, sizeof(pt)) == 0);
+
+        fast_cleanup(both);
+        fast_cleanup(enc_only);
+        fast_cleanup(dec_only);
+    }
+    printf("✓ Encrypt-only, decrypt-only and lazily inverted contexts agree\n");
+
+    fast_params_t   params;
+    fast_context_t *ctx;
+    assert(calculate_recommended_params(&params, 10, 16) == 0);
+    assert(fast_init_ex(&ctx, &params, key, FAST_INIT_ENCRYPT_ONLY | FAST_INIT_DECRYPT_ONLY) ==
+           -1);
+    printf("✓ Direction flags are exclusive\n");
+}
+
+static void
+test_init_into()
+{
+    printf("\n=== Testing Contexts in Caller Memory ===\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+                                       0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+
+    fast_params_t params;
+    assert(calculate_recommended_params(&params, 10, 16) == 0);
+
+    const size_t size = fast_context_size(&params, 0);
+    assert(size > 0);
+    assert(fast_context_size(&params, FAST_INIT_ENCRYPT_ONLY) < size);
+    assert(fast_context_size(&params, FAST_INIT_ENCRYPT_ONLY | FAST_INIT_DECRYPT_ONLY) == 0);
+
+    // Deliberately misaligned, and exactly as large as asked for
+    uint8_t        *storage = malloc(size + 1);
+    uint8_t        *buffer  = storage + 1;
+    fast_context_t *ctx, *ref;
+    assert(storage);
+    assert(fast_init_into(&ctx, buffer, size - 1, &params, key, 0) == -1);
+    assert(fast_init_into(&ctx, buffer, size, &params, key, 0) == 0);
+    assert((uint8_t *) ctx >= buffer && (uint8_t *) ctx < buffer + size);
+    assert(fast_init(&ref, &params, key) == 0);
+
+    // Tweaks past the sequence cache are derived again on every call
+    uint8_t long_tweak[FAST_TWEAK_CACHE_SIZE + 1];
+    for (size_t i = 0; i < sizeof(long_tweak); i++) {
+        long_tweak[i] = (uint8_t) i;
+    }
+
+    uint8_t pt[16], ct[16], expected[16], out[16];
+    for (size_t i = 0; i < sizeof(pt); i++) {
+        pt[i] = (uint8_t) ((i * 7 + 3) % 10);
+    }
+    for (int round = 0; round < 2; round++) {
+        const uint8_t *tweak     = round ? long_tweak : DEFAULT_TWEAK;
+        const size_t   tweak_len = round ? sizeof(long_tweak) : DEFAULT_TWEAK_LEN;
+        for (int repeat = 0; repeat < 2; repeat++) {
+            assert(fast_encrypt(ref, tweak, tweak_len, pt, expected, sizeof(pt)) == 0);
+            assert(fast_encrypt(ctx, tweak, tweak_len, pt, ct, sizeof(pt)) == 0);
+            assert(memcmp(ct, expected, sizeof(ct)) == 0);
+            // The first decryption builds the inverse tables inside the buffer
+            assert(fast_decrypt(ctx, tweak, tweak_len, ct, out, sizeof(ct)) == 0);
+            assert(memcmp(out, pt, sizeof(pt)) == 0);
+        }
+    }
+    fast_cleanup(ctx);
+    printf("✓ Context in a misaligned caller buffer matches a heap context\n");
+
+    // The buffer is free for another context once cleaned up
+    assert(fast_init_into(&ctx, buffer, size, &params, key, FAST_INIT_DECRYPT_ONLY) == 0);
+    assert(fast_encrypt(ref, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, pt, ct, sizeof(pt)) == 0);
+    assert(fast_decrypt(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, ct, out, sizeof(ct)) == 0);
+    assert(memcmp(out, pt, sizeof(pt)) == 0);
+    fast_cleanup(ctx);
+    fast_cleanup(ref);
+    free(storage);
+    printf("✓ Caller buffer reused after cleanup\n");
+}
+
+static void
+test_sequence_widths()
+{
+    printf("\n=== Testing Compact Layer Sequences ===\n");
+
+    uint8_t material[FAST_DERIVED_KEY_SIZE];
+    for (size_t i = 0; i < sizeof(material); i++) {
+        material[i] = (uint8_t) (i * 11 + 1);
+    }
+
+    // One byte per layer up to 256 S-boxes, two above; nothing is written past the sequence
+    uint8_t  seq8[65];
+    uint16_t seq16[65];
+    memset(seq8, 0xAA, sizeof(seq8));
+    memset(seq16, 0xAA, sizeof(seq16));
+    assert(fast_generate_sequence(seq8, 64, 256, material, sizeof(material)) == 0);
+    assert(fast_generate_sequence(seq16, 64, 300, material, sizeof(material)) == 0);
+    assert(seq8[64] == 0xAA && seq16[64] == 0xAAAA);
+    bool high = false;
+    for (size_t i = 0; i < 64; i++) {
+        assert(seq16[i] < 300);
+        high = high || seq16[i] >= 256;
+    }
+    assert(high);
+    assert(fast_generate_sequence(seq16, 64, FAST_MAX_SBOX_COUNT + 1, material,
+                                  sizeof(material)) == -1);
+    printf("✓ Sequences take one byte per layer up to 256 S-boxes, two above\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0 };
+    uint8_t pt[16], ct[16], out[16];
+    for (size_t i = 0; i < sizeof(pt); i++) {
+        pt[i] = (uint8_t) (i % 10);
+    }
+
+    fast_params_t   params;
+    fast_context_t *ctx;
+    assert(calculate_recommended_params(&params, 10, 16) == 0);
+    params.sbox_count = 300;
+    assert(fast_init(&ctx, &params, key) == 0);
+    assert(fast_encrypt(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, pt, ct, sizeof(pt)) == 0);
+    assert(fast_decrypt(ctx, DEFAULT_TWEAK, DEFAULT_TWEAK_LEN, ct, out, sizeof(ct)) == 0);
+    assert(memcmp(pt, out, sizeof(pt)) == 0);
+    fast_cleanup(ctx);
+
+    params.sbox_count = FAST_MAX_SBOX_COUNT + 1;
+    assert(fast_init(&ctx, &params, key) == -1);
+    printf("✓ Pools above 256 S-boxes round-trip, above FAST_MAX_SBOX_COUNT are rejected\n");
+}
+
+static void
+test_placement()
+{
+    printf("\n=== Testing Huge Pages and NUMA Replicas ===\n");
+
+    uint8_t key[FAST_AES_KEY_SIZE] = { 0x60, 0x3D, 0xEB, 0x10, 0x15, 0xCA, 0x71, 0xBE,
+                                       0x2B, 0x73, 0xAE, 0xF0, 0x85, 0x7D, 0x77, 0x81 };
+
+    // Three nodes whatever the host, so that calls can be moved to another replica
+    const uint32_t flag_sets[] = {
+        FAST_INIT_HUGE_PAGES,
+        FAST_INIT_NUMA_REPLICAS,
+        FAST_INIT_NUMA_REPLICAS | FAST_INIT_HUGE_PAGES | FAST_INIT_JIT,
+        FAST_INIT_NUMA_REPLICAS | FAST_INIT_DECRYPT_ONLY,
+    };
+    const uint32_t radices[] = { 10, 256, 1000 };
+    for (size_t r = 0; r < sizeof(radices) / sizeof(radices[0]); r++) {
+        const uint32_t  radix = radices[r];
+        fast_params_t   params;
+        fast_context_t *ref;
+        memset(&params, 0, sizeof(params));
+        assert(calculate_recommended_params(&params, radix, 12) == 0);
+        assert(fast_init(&ref, &params, key) == 0);
+
+        uint16_t pt[12], ct[12], out[12];
+        for (size_t i = 0; i < 12; i++) {
+            pt[i] = (uint16_t) ((i * 53 + 7) % radix);
+        }
+        assert(crypt_word(ref, radix, false, pt, ct) == 0);
+
+        for (size_t f = 0; f < sizeof(flag_sets) / sizeof(flag_sets[0]); f++) {
+            const uint32_t  flags = flag_sets[f];
+            fast_context_t *ctx;
+            fast_numa_simulate(3, 2);
+            assert(fast_init_ex(&ctx, &params, key, flags) == 0);
+            if ((flags & FAST_INIT_DECRYPT_ONLY) == 0) {
+                assert(crypt_word(ctx, radix, false, pt, out) == 0);
+                assert(memcmp(ct, out, sizeof(ct)) == 0);
+            }
+            // Another node's replica, with its inverse tables built on this first decryption
+            fast_numa_simulate(3, 0);
+            assert(crypt_word(ctx, radix, true, ct, out) == 0);
+            assert(memcmp(pt, out, sizeof(pt)) == 0);
+            fast_numa_simulate(3, 1);
+            assert(crypt_word(ctx, radix, true, ct, out) == 0);
+            assert(memcmp(pt, out, sizeof(pt)) == 0);
+            fast_cleanup(ctx);
+        }
+        fast_cleanup(ref);
+    }
+    fast_numa_simulate(0, 0);
+    printf("✓ Huge-page contexts and every NUMA replica match a heap context\n");
+
+    fast_params_t   params;
+    fast_context_t *ctx;
+    uint8_t         buffer[64];
+    assert(calculate_recommended_params(&params, 10, 16) == 0);
+    assert(fast_context_size(&params, FAST_INIT_HUGE_PAGES) == 0);
+    assert(fast_context_size(&params, FAST_INIT_NUMA_REPLICAS) == 0);
+    assert(fast_init_into(&ctx, buffer, sizeof(buffer), &params, key, FAST_INIT_HUGE_PAGES) == -1);
+    printf("✓ Placement flags are rejected for caller memory\n");
 }
 
 int
@@ -180,8 +1030,19 @@ main()
 
     test_sbox_generation();
     test_prng_determinism();
+    test_prf();
     test_encrypt_decrypt();
     test_different_inputs();
+    test_batch_matches_single();
+    test_cpu_tiers();
+    test_jit();
+    test_autotune();
+    test_long_messages();
+    test_wide_symbols();
+    test_directions();
+    test_init_into();
+    test_sequence_widths();
+    test_placement();
 
     printf("\n==============================\n");
     printf("All tests passed successfully!\n");
@@ -0,0 +1,622 @@
+#include "fast.h"
+#include "fast_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Kernel conformance harness
+//
+// Every compiled-in kernel the CPU can run (scalar, shape-specialized, vector, batch and JIT) is
+// checked bit for bit against the reference layers fast_es_layer / fast_ds_layer (and their 16-bit
+// versions), on a fixed set of coverage shapes followed by random ones: radix 4-65536, word
+// length 2-1024, random branch distances, key material (standing in for the tweak) and words. The
+// public API is then checked against known-answer vectors from gen_vectors under every CPU tier,
+// with and without the JIT. The throughput of each kernel over the whole run is reported at the
+// end.
+//
+// Usage: test_kernels [trials [seed]]
+
+#define MAX_WORD_LENGTH 1024U
+// Layers times words per trial, bounding the reference run
+#define TRIAL_WORK (1U << 18)
+#define MAX_STATS  64U
+
+typedef struct {
+    const fast_kernel_t *kernel;
+    bool                 decrypt;
+    bool                 batch;
+    size_t               trials;
+    double               layer_words; // Layers applied to a word, summed over the run
+    double               seconds;
+} kernel_stats_t;
+
+typedef struct {
+    fast_params_t   params;
+    sbox_pool_t     pool;
+    uint8_t        *seq;
+    layer_program_t prog;
+    size_t          words;
+    size_t          symbol; // Bytes per symbol, 2 above FAST_MAX_RADIX
+    uint8_t        *input;
+    uint8_t        *expected; // Reference ciphertexts
+    uint8_t        *output;
+} fixture_t;
+
+typedef struct {
+    uint32_t      radix;
+    uint32_t      word_length;
+    uint32_t      tweak; // Index into k_kat_tweaks
+    const uint8_t ciphertext[32];
+} kat_t;
+
+static kernel_stats_t stats[MAX_STATS];
+static size_t         stats_count;
+static uint64_t       rng_state;
+
+// Coverage shapes: the default FAST_SHAPES entries and the radix and length boundaries of the
+// vector kernels, as radix, word length, w, w' (w' = 0 for the recommended distances)
+static const uint32_t k_coverage[][4] = {
+    { 10, 16, 4, 3 },  { 10, 19, 5, 4 },  { 10, 9, 3, 2 },    { 36, 12, 4, 3 },
+    { 4, 2, 0, 0 },    { 16, 3, 0, 0 },   { 16, 256, 0, 0 },  { 17, 257, 0, 0 },
+    { 64, 40, 0, 0 },  { 65, 40, 0, 0 },  { 128, 33, 0, 0 },  { 129, 33, 0, 0 },
+    { 255, 12, 0, 0 }, { 256, 2, 0, 0 },  { 256, 300, 0, 0 }, { 7, 1024, 0, 0 },
+    { 10, 16, 0, 1 },  { 100, 20, 7, 12 }, { 257, 9, 0, 0 },   { 1000, 16, 0, 0 },
+    { 65536, 4, 0, 0 },
+};
+
+// Radices where kernel selection changes, drawn half of the time by the random trials
+static const uint32_t k_boundary_radices[] = { 4,   15,  16,  17,  64,  65,
+                                               127, 128, 129, 255, 256, 257 };
+
+static const uint8_t k_kat_key[FAST_AES_KEY_SIZE] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae,
+                                                      0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88,
+                                                      0x09, 0xcf, 0x4f, 0x3c };
+
+static const struct {
+    const uint8_t *data;
+    size_t         len;
+} k_kat_tweaks[] = {
+    { (const uint8_t *) "\x00\x11\x22\x33\x44\x55\x66\x77", 8 },
+    { NULL, 0 },
+    { (const uint8_t *) "\xAA\xBB", 2 },
+};
+
+// Ciphertexts of the sequential plaintext (i mod radix) from gen_vectors, recommended parameters
+static const kat_t k_kats[] = {
+    { 4, 2, 0, { 2, 2 } },
+    { 4, 2, 1, { 0, 2 } },
+    { 4, 2, 2, { 2, 1 } },
+    { 4, 4, 0, { 1, 3, 0, 2 } },
+    { 4, 4, 1, { 2, 0, 3, 2 } },
+    { 4, 4, 2, { 3, 1, 1, 2 } },
+    { 4, 8, 0, { 3, 1, 1, 3, 0, 2, 2, 2 } },
+    { 4, 8, 1, { 3, 1, 3, 1, 2, 0, 3, 3 } },
+    { 4, 8, 2, { 1, 1, 0, 1, 3, 0, 3, 0 } },
+    { 4, 16, 0, { 2, 3, 2, 3, 2, 1, 1, 1, 2, 0, 0, 0, 0, 3, 2, 0 } },
+    { 4, 16, 1, { 3, 0, 3, 2, 0, 3, 3, 3, 0, 1, 1, 1, 1, 2, 0, 1 } },
+    { 4, 16, 2, { 3, 0, 2, 1, 3, 2, 1, 1, 0, 1, 1, 3, 3, 1, 2, 1 } },
+    { 10, 2, 0, { 5, 2 } },
+    { 10, 2, 1, { 3, 5 } },
+    { 10, 2, 2, { 2, 2 } },
+    { 10, 3, 0, { 5, 6, 7 } },
+    { 10, 3, 1, { 2, 9, 0 } },
+    { 10, 3, 2, { 7, 9, 6 } },
+    { 10, 4, 0, { 5, 5, 8, 7 } },
+    { 10, 4, 1, { 0, 1, 0, 4 } },
+    { 10, 4, 2, { 0, 6, 6, 4 } },
+    { 10, 8, 0, { 5, 9, 7, 2, 7, 2, 7, 7 } },
+    { 10, 8, 1, { 4, 6, 1, 2, 4, 8, 3, 6 } },
+    { 10, 8, 2, { 0, 4, 8, 5, 1, 9, 2, 6 } },
+    { 10, 10, 0, { 4, 4, 0, 6, 9, 6, 5, 8, 5, 5 } },
+    { 10, 10, 1, { 2, 5, 2, 7, 2, 8, 7, 3, 4, 5 } },
+    { 10, 10, 2, { 8, 0, 8, 1, 8, 3, 1, 2, 2, 9 } },
+    { 10, 16, 0, { 4, 0, 8, 8, 3, 7, 4, 8, 8, 1, 0, 8, 7, 8, 9, 1 } },
+    { 10, 16, 1, { 1, 8, 8, 5, 0, 6, 1, 1, 9, 2, 9, 7, 7, 2, 8, 8 } },
+    { 10, 16, 2, { 3, 1, 4, 2, 7, 4, 6, 5, 1, 4, 7, 7, 5, 1, 0, 0 } },
+    { 10, 19, 0, { 3, 0, 9, 3, 6, 6, 3, 4, 2, 9, 8, 1, 8, 0, 7, 2, 3, 0, 2 } },
+    { 10, 19, 1, { 3, 2, 4, 2, 3, 9, 2, 9, 5, 0, 8, 7, 9, 7, 2, 3, 3, 1, 3 } },
+    { 10, 19, 2, { 1, 9, 6, 8, 9, 9, 2, 1, 9, 3, 3, 7, 4, 0, 3, 9, 3, 2, 2 } },
+    { 10, 32, 0, { 2, 9, 9, 8, 6, 3, 2, 3, 0, 7, 9, 3, 4, 1, 4, 3, 0, 2, 0, 6, 5, 8, 4, 2, 6, 4, 5,
+                   4, 0, 8, 8, 3 } },
+    { 10, 32, 1, { 5, 1, 6, 8, 2, 7, 2, 2, 8, 5, 3, 8, 7, 0, 1, 8, 1, 5, 0, 2, 7, 1, 8, 7, 2, 2, 3,
+                   6, 2, 8, 8, 8 } },
+    { 10, 32, 2, { 1, 4, 2, 9, 2, 2, 0, 5, 0, 9, 1, 0, 8, 2, 1, 4, 1, 8, 0, 2, 8, 4, 4, 3, 3, 3, 5,
+                   3, 7, 7, 6, 2 } },
+    { 16, 2, 0, { 4, 0 } },
+    { 16, 2, 1, { 11, 2 } },
+    { 16, 2, 2, { 15, 5 } },
+    { 16, 4, 0, { 11, 10, 10, 12 } },
+    { 16, 4, 1, { 2, 3, 8, 14 } },
+    { 16, 4, 2, { 4, 0, 14, 6 } },
+    { 16, 8, 0, { 12, 15, 5, 1, 6, 8, 11, 11 } },
+    { 16, 8, 1, { 15, 7, 0, 8, 14, 3, 11, 5 } },
+    { 16, 8, 2, { 6, 15, 12, 5, 7, 6, 10, 4 } },
+    { 16, 16, 0, { 11, 7, 2, 5, 13, 13, 8, 10, 0, 1, 13, 2, 11, 6, 7, 15 } },
+    { 16, 16, 1, { 12, 11, 8, 0, 6, 13, 7, 3, 9, 6, 1, 10, 13, 2, 1, 7 } },
+    { 16, 16, 2, { 3, 15, 5, 3, 15, 2, 6, 8, 6, 11, 12, 12, 15, 12, 4, 8 } },
+    { 36, 4, 0, { 11, 35, 3, 11 } },
+    { 36, 4, 1, { 3, 14, 9, 22 } },
+    { 36, 4, 2, { 10, 23, 25, 12 } },
+    { 36, 8, 0, { 23, 21, 19, 1, 3, 33, 15, 26 } },
+    { 36, 8, 1, { 11, 28, 7, 15, 14, 9, 3, 35 } },
+    { 36, 8, 2, { 21, 10, 19, 3, 22, 13, 2, 24 } },
+    { 62, 4, 0, { 43, 33, 37, 56 } },
+    { 62, 4, 1, { 3, 10, 20, 34 } },
+    { 62, 4, 2, { 1, 48, 17, 61 } },
+    { 62, 8, 0, { 36, 16, 53, 9, 47, 33, 52, 60 } },
+    { 62, 8, 1, { 29, 34, 36, 14, 46, 2, 14, 47 } },
+    { 62, 8, 2, { 56, 6, 28, 19, 26, 16, 29, 11 } },
+    { 256, 2, 0, { 187, 16 } },
+    { 256, 2, 1, { 170, 220 } },
+    { 256, 2, 2, { 182, 54 } },
+    { 256, 4, 0, { 50, 73, 110, 228 } },
+    { 256, 4, 1, { 54, 39, 131, 232 } },
+    { 256, 4, 2, { 145, 194, 219, 109 } },
+    { 256, 8, 0, { 154, 100, 19, 198, 147, 206, 29, 212 } },
+    { 256, 8, 1, { 58, 177, 85, 141, 43, 242, 7, 202 } },
+    { 256, 8, 2, { 244, 230, 39, 160, 63, 31, 7, 179 } },
+    { 256, 16, 0, { 249, 238, 52, 0, 7, 19, 191, 118, 29, 39, 208, 86, 208, 24, 229, 205 } },
+    { 256, 16, 1, { 125, 198, 198, 44, 230, 41, 173, 229, 176, 98, 17, 235, 50, 76, 97, 103 } },
+    { 256, 16, 2, { 36, 4, 49, 12, 132, 163, 240, 216, 143, 157, 13, 34, 88, 213, 133, 76 } },
+    { 256, 32, 0, { 36, 213, 84, 156, 13, 45, 151, 113, 57, 220, 230, 250, 23, 245, 252, 165, 3,
+                    165, 195, 80, 91, 208, 203, 38, 31, 92, 121, 206, 253, 25, 115, 158 } },
+    { 256, 32, 1, { 179, 163, 149, 247, 179, 140, 113, 7, 200, 172, 11, 165, 63, 207, 207, 100, 65,
+                    178, 186, 151, 189, 153, 196, 174, 175, 176, 241, 61, 245, 4, 151, 22 } },
+    { 256, 32, 2, { 159, 205, 227, 4, 247, 250, 89, 111, 93, 131, 32, 253, 8, 115, 145, 194, 248,
+                    103, 70, 195, 163, 156, 239, 47, 72, 159, 228, 116, 4, 124, 200, 175 } },
+};
+
+static uint64_t
+rng_next(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t
+rng_range(uint32_t lo, uint32_t hi)
+{
+    return lo + (uint32_t) (rng_next() % ((uint64_t) hi - lo + 1));
+}
+
+static kernel_stats_t *
+stats_for(const fast_kernel_t *kernel, bool decrypt, bool batch)
+{
+    for (size_t i = 0; i < stats_count; i++) {
+        if (stats[i].kernel == kernel && stats[i].decrypt == decrypt && stats[i].batch == batch) {
+            return &stats[i];
+        }
+    }
+    if (stats_count == MAX_STATS) {
+        fprintf(stderr, "too many kernels\n");
+        exit(1);
+    }
+    kernel_stats_t *s = &stats[stats_count++];
+    memset(s, 0, sizeof(*s));
+    s->kernel  = kernel;
+    s->decrypt = decrypt;
+    s->batch   = batch;
+    return s;
+}
+
+static void
+set_symbol(const fixture_t *f, uint8_t *words, size_t i, uint32_t value)
+{
+    if (f->symbol == sizeof(uint16_t)) {
+        const uint16_t v = (uint16_t) value;
+        memcpy(words + i * sizeof(v), &v, sizeof(v));
+    } else {
+        words[i] = (uint8_t) value;
+    }
+}
+
+static void
+free_fixture(fixture_t *f)
+{
+    fast_jit_release(&f->prog);
+    free_sbox_pool(&f->pool);
+    free(f->seq);
+    free(f->input);
+    free(f->expected);
+    free(f->output);
+}
+
+static int
+setup_fixture(fixture_t *f, const fast_params_t *params)
+{
+    memset(f, 0, sizeof(*f));
+    f->params = *params;
+    f->symbol = params->radix > FAST_MAX_RADIX ? sizeof(uint16_t) : sizeof(uint8_t);
+
+    const uint32_t ell    = params->word_length;
+    const uint32_t layers = params->num_layers;
+    uint8_t        key_material[FAST_DERIVED_KEY_SIZE];
+    for (size_t i = 0; i < sizeof(key_material); i++) {
+        key_material[i] = (uint8_t) rng_next();
+    }
+
+    if (fast_generate_sbox_pool(&f->pool, params->sbox_count, params->radix, key_material,
+                                sizeof(key_material), FAST_SBOX_FORWARD | FAST_SBOX_INVERSE,
+                                NULL) != 0) {
+        return -1;
+    }
+    key_material[0] ^= 0xFF;
+
+    f->seq = malloc(layers * seq_entry_size(params->sbox_count));
+    if (!f->seq || fast_generate_sequence(f->seq, layers, params->sbox_count, key_material,
+                                          sizeof(key_material)) != 0) {
+        return -1;
+    }
+
+    // The program covers every table family the pool provides, so every kernel can run off it
+    if (fast_compile_program(&f->prog, &f->pool, f->seq, layers) != 0) {
+        return -1;
+    }
+    if (fast_jit_available(params)) {
+        (void) fast_jit_compile(&f->prog, params);
+    }
+
+    // An odd number of words, so that batch kernels also see a partial group
+    f->words = TRIAL_WORK / layers;
+    f->words = f->words < 3 ? 3 : f->words > 67 ? 67 : f->words;
+    f->words |= 1;
+
+    const size_t word_bytes = ell * f->symbol;
+    const size_t bytes      = f->words * word_bytes;
+    f->input                = malloc(bytes);
+    f->expected             = malloc(bytes);
+    f->output               = malloc(bytes);
+    if (!f->input || !f->expected || !f->output) {
+        return -1;
+    }
+
+    // Random words, plus all-zero and all-maximum ones
+    for (size_t i = 0; i < f->words * ell; i++) {
+        const uint32_t value = i < ell ? 0 : i < 2 * ell ? params->radix - 1 : rng_next();
+        set_symbol(f, f->input, i, value % params->radix);
+    }
+
+    const bool wide = f->symbol == sizeof(uint16_t);
+    memcpy(f->expected, f->input, bytes);
+    for (size_t k = 0; k < f->words; k++) {
+        uint8_t *word = f->expected + k * word_bytes;
+        for (uint32_t l = 0; l < layers; l++) {
+            if (wide) {
+                fast_es_layer16(params, &f->pool, (uint16_t *) (void *) word, ell,
+                                layer_sbox(&f->prog, l));
+            } else {
+                fast_es_layer(params, &f->pool, word, ell, layer_sbox(&f->prog, l));
+            }
+        }
+    }
+
+    // The reference layers must invert each other before anything is compared against them
+    memcpy(f->output, f->expected, bytes);
+    for (size_t k = 0; k < f->words; k++) {
+        uint8_t *word = f->output + k * word_bytes;
+        for (uint32_t l = layers; l-- > 0;) {
+            if (wide) {
+                fast_ds_layer16(params, &f->pool, (uint16_t *) (void *) word, ell,
+                                layer_sbox(&f->prog, l));
+            } else {
+                fast_ds_layer(params, &f->pool, word, ell, layer_sbox(&f->prog, l));
+            }
+        }
+    }
+    if (memcmp(f->output, f->input, bytes) != 0) {
+        fprintf(stderr, "reference layers do not round-trip\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+report_params(const fast_params_t *p)
+{
+    fprintf(stderr, "  radix %u, length %u, w %u, w' %u, %u layers\n", p->radix, p->word_length,
+            p->branch_dist1, p->branch_dist2, p->num_layers);
+}
+
+// Runs one kernel function over the fixture's words; returns -1 on a mismatch
+static int
+check_kernel(const fixture_t *f, const fast_kernel_t *kernel, bool decrypt, bool batch)
+{
+    const size_t   ell   = f->params.word_length * f->symbol;
+    const size_t   bytes = f->words * ell;
+    const uint8_t *from  = decrypt ? f->expected : f->input;
+    const uint8_t *to    = decrypt ? f->input : f->expected;
+
+    memcpy(f->output, from, bytes);
+
+    const clock_t start = clock();
+    if (batch) {
+        kernel->batch(&f->params, &f->prog, f->output, f->words);
+    } else {
+        for (size_t k = 0; k < f->words; k++) {
+            kernel->run(&f->params, &f->prog, f->output + k * ell);
+        }
+    }
+    const clock_t end = clock();
+
+    for (size_t k = 0; k < f->words; k++) {
+        if (memcmp(f->output + k * ell, to + k * ell, ell) != 0) {
+            fprintf(stderr, "MISMATCH: %s %s kernel \"%s\", word %zu of %zu\n",
+                    decrypt ? "decrypt" : "encrypt", batch ? "batch" : "word", kernel->name, k,
+                    f->words);
+            report_params(&f->params);
+            return -1;
+        }
+    }
+
+    kernel_stats_t *s = stats_for(kernel, decrypt, batch);
+    s->trials++;
+    s->layer_words += (double) f->words * f->params.num_layers;
+    s->seconds += (double) (end - start) / CLOCKS_PER_SEC;
+    return 0;
+}
+
+static int
+check_kernels(const fixture_t *f, fast_cpu_tier_t tier)
+{
+    for (int decrypt = 0; decrypt < 2; decrypt++) {
+        const fast_kernel_t *const *registry =
+            decrypt ? fast_decrypt_kernels : fast_encrypt_kernels;
+        const fast_kernel_t *jit = decrypt ? &fast_jit_decrypt_kernel : &fast_jit_encrypt_kernel;
+
+        for (size_t i = 0;; i++) {
+            const fast_kernel_t *kernel = registry[i] ? registry[i] : jit;
+            if (kernel->tier <= tier && kernel->supports(&f->params, &f->pool)) {
+                if (kernel->run && check_kernel(f, kernel, decrypt, false) != 0) {
+                    return -1;
+                }
+                if (kernel->batch && check_kernel(f, kernel, decrypt, true) != 0) {
+                    return -1;
+                }
+            }
+            if (!registry[i]) {
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+static int
+run_trial(const fast_params_t *params, fast_cpu_tier_t tier)
+{
+    fixture_t f;
+    int       status = setup_fixture(&f, params);
+    if (status != 0) {
+        fprintf(stderr, "setup failed\n");
+        report_params(params);
+    } else {
+        status = check_kernels(&f, tier);
+    }
+    free_fixture(&f);
+    return status;
+}
+
+// The dispatch wrappers fail closed: a word of the wrong length, or a program without the tables
+// the kernel reads, is an error rather than a silent no-op
+static int
+check_guards(fast_cpu_tier_t tier)
+{
+    fast_params_t params;
+    fixture_t     f;
+    int           status = -1;
+
+    memset(&params, 0, sizeof(params));
+    calculate_recommended_params(&params, 10, 16);
+    if (setup_fixture(&f, &params) == 0) {
+        const sbox_pool_t   *pool  = &f.pool;
+        const fast_kernel_t *enc   = fast_select_kernel(fast_encrypt_kernels, &params, pool, tier);
+        const fast_kernel_t *dec   = fast_select_kernel(fast_decrypt_kernels, &params, pool, tier);
+        const fast_kernel_t *batch = fast_select_batch_kernel(fast_encrypt_kernels, &params, pool,
+                                                              tier);
+        const size_t         ell   = params.word_length;
+        layer_program_t      bare  = f.prog;
+
+        bare.enc[enc->tables]   = NULL;
+        bare.dec[dec->tables]   = NULL;
+        bare.enc[batch->tables] = NULL;
+        if (fast_cenc(enc, &params, &f.prog, f.input, f.output, ell) == 0 &&
+            memcmp(f.output, f.expected, ell) == 0 &&
+            fast_cenc(enc, &params, &f.prog, f.input, f.output, ell - 1) == -1 &&
+            fast_cenc(enc, &params, &bare, f.input, f.output, ell) == -1 &&
+            fast_cdec(dec, &params, &bare, f.expected, f.output, ell) == -1 &&
+            fast_cenc_batch(batch, &params, &bare, f.input, f.output, ell, f.words) == -1) {
+            status = 0;
+        }
+    }
+    if (status != 0) {
+        fprintf(stderr, "dispatch guards do not fail closed\n");
+    }
+    free_fixture(&f);
+    return status;
+}
+
+// Random parameters: recommended ones, or random branch distances half of the time. Radices are
+// uniform in 4-256, a boundary, or wide (log-uniform up to 65536) for one trial in eight. One byte
+// radix in eight gets a pool of more than 256 S-boxes, and so 16-bit layer sequences.
+static void
+random_params(fast_params_t *params)
+{
+    const size_t   boundaries = sizeof(k_boundary_radices) / sizeof(k_boundary_radices[0]);
+    const uint32_t pick       = (uint32_t) (rng_next() % 8);
+    const uint32_t wide_bits  = rng_range(9, 16);
+    const uint32_t radix      = pick == 0   ? rng_range((1U << wide_bits) / 2 + 1, 1U << wide_bits)
+                                : pick <= 4 ? rng_range(4, 256)
+                                            : k_boundary_radices[rng_next() % boundaries];
+    // Log-uniform word length, so that short words are not drowned out
+    const uint32_t bits = rng_range(1, 10);
+    uint32_t       ell  = rng_range((1U << bits) / 2 + 1, 1U << bits);
+    ell                 = ell < 2 ? 2 : ell;
+
+    memset(params, 0, sizeof(*params));
+    calculate_recommended_params(params, radix, ell);
+    if (rng_next() & 1) {
+        params->branch_dist1 = rng_range(0, ell - 2);
+        params->branch_dist2 = rng_range(1, ell - params->branch_dist1 - 1);
+    }
+    if (radix <= FAST_MAX_RADIX && rng_next() % 8 == 0) {
+        params->sbox_count = rng_range(257, 1024);
+    }
+}
+
+// Word and batch paths in both directions
+static bool
+kat_matches(fast_context_t *ctx, const uint8_t *tweak, size_t tweak_len, const kat_t *kat,
+            const uint8_t *pt)
+{
+    const uint32_t ell = kat->word_length;
+    uint8_t        ct[32];
+
+    if (fast_encrypt(ctx, tweak, tweak_len, pt, ct, ell) != 0 ||
+        memcmp(ct, kat->ciphertext, ell) != 0) {
+        return false;
+    }
+    if (fast_decrypt_batch(ctx, tweak, tweak_len, ct, ct, ell, 1) != 0 ||
+        memcmp(ct, pt, ell) != 0) {
+        return false;
+    }
+    if (fast_encrypt_batch(ctx, tweak, tweak_len, pt, ct, ell, 1) != 0 ||
+        memcmp(ct, kat->ciphertext, ell) != 0) {
+        return false;
+    }
+    return fast_decrypt(ctx, tweak, tweak_len, ct, ct, ell) == 0 && memcmp(ct, pt, ell) == 0;
+}
+
+static int
+check_kats(fast_cpu_tier_t detected)
+{
+    size_t checked = 0;
+
+    for (int tier = FAST_CPU_TIER_SCALAR; tier <= (int) detected; tier++) {
+        if (fast_set_cpu_tier((fast_cpu_tier_t) tier) != 0) {
+            return -1;
+        }
+        for (int jit = 0; jit < 2; jit++) {
+            for (size_t i = 0; i < sizeof(k_kats) / sizeof(k_kats[0]); i++) {
+                const kat_t   *kat = &k_kats[i];
+                const uint32_t ell = kat->word_length;
+                fast_params_t  params;
+                uint8_t        pt[32];
+
+                memset(&params, 0, sizeof(params));
+                calculate_recommended_params(&params, kat->radix, ell);
+                for (uint32_t j = 0; j < ell; j++) {
+                    pt[j] = (uint8_t) (j % kat->radix);
+                }
+
+                fast_context_t *ctx;
+                if (fast_init_ex(&ctx, &params, k_kat_key, jit ? FAST_INIT_JIT : 0) != 0) {
+                    return -1;
+                }
+                const uint8_t *tweak     = k_kat_tweaks[kat->tweak].data;
+                const size_t   tweak_len = k_kat_tweaks[kat->tweak].len;
+                const bool     ok        = kat_matches(ctx, tweak, tweak_len, kat, pt);
+                fast_cleanup(ctx);
+
+                if (!ok) {
+                    fprintf(stderr, "KAT %zu FAILED: radix %u, length %u, tier %s%s\n", i,
+                            kat->radix, ell, fast_cpu_tier_name((fast_cpu_tier_t) tier),
+                            jit ? ", JIT" : "");
+                    return -1;
+                }
+                checked++;
+            }
+        }
+    }
+
+    printf("✓ %zu known-answer checks across tiers up to %s, with and without JIT\n", checked,
+           fast_cpu_tier_name(detected));
+    return fast_set_cpu_tier(FAST_CPU_TIER_AUTO);
+}
+
+static void
+print_stats(void)
+{
+    printf("\n%-14s %-8s %-6s %7s %14s\n", "kernel", "dir", "mode", "trials", "ns/word-layer");
+    for (int decrypt = 0; decrypt < 2; decrypt++) {
+        for (size_t i = 0; i < stats_count; i++) {
+            const kernel_stats_t *s = &stats[i];
+            if (s->decrypt != decrypt) {
+                continue;
+            }
+            printf("%-14s %-8s %-6s %7zu %14.3f\n", s->kernel->name,
+                   decrypt ? "decrypt" : "encrypt", s->batch ? "batch" : "word", s->trials,
+                   s->seconds * 1e9 / s->layer_words);
+        }
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    const unsigned long trials = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+    const uint64_t      seed   = argc > 2 ? strtoull(argv[2], NULL, 10) : 0x5EED;
+
+    printf("FAST Kernel Conformance\n");
+    printf("=======================\n");
+
+    const fast_cpu_tier_t tier = fast_cpu_tier();
+    printf("CPU tier: %s, seed %llu, %lu random trials\n", fast_cpu_tier_name(tier),
+           (unsigned long long) seed, trials);
+    rng_state = seed ? seed : 1;
+
+    // Every shape over the default pool, then the byte radices again over a pool of 300 S-boxes,
+    // whose layer sequences take 16 bits per layer
+    size_t shapes = 0;
+    for (int large_pool = 0; large_pool < 2; large_pool++) {
+        for (size_t i = 0; i < sizeof(k_coverage) / sizeof(k_coverage[0]); i++) {
+            if (large_pool && k_coverage[i][0] > FAST_MAX_RADIX) {
+                continue;
+            }
+            fast_params_t params;
+            memset(&params, 0, sizeof(params));
+            calculate_recommended_params(&params, k_coverage[i][0], k_coverage[i][1]);
+            if (k_coverage[i][3] != 0) {
+                params.branch_dist1 = k_coverage[i][2];
+                params.branch_dist2 = k_coverage[i][3];
+            }
+            if (large_pool) {
+                params.sbox_count = 300;
+            }
+            if (run_trial(&params, tier) != 0) {
+                return 1;
+            }
+            shapes++;
+        }
+    }
+    printf("✓ %zu coverage shapes\n", shapes);
+
+    for (unsigned long t = 0; t < trials; t++) {
+        fast_params_t params;
+        random_params(&params);
+        if (run_trial(&params, tier) != 0) {
+            fprintf(stderr, "  random trial %lu, seed %llu\n", t, (unsigned long long) seed);
+            return 1;
+        }
+    }
+    printf("✓ %lu random trials\n", trials);
+
+    if (check_guards(tier) != 0) {
+        return 1;
+    }
+    printf("✓ Dispatch wrappers reject mismatched programs\n");
+
+    if (check_kats(tier) != 0) {
+        return 1;
+    }
+
+    print_stats();
+
+    printf("\n=======================\n");
+    printf("All kernels conform!\n");
+    return 0;
+}
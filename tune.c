@@ -0,0 +1,345 @@
+#define _POSIX_C_SOURCE 200112L
+#include "fast_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Kernel autotuner
+//
+// With FAST_INIT_AUTOTUNE, each entry point (word and batch, in both directions) is bound to the
+// fastest kernel able to serve it rather than to the first one in registry order. Candidates are
+// timed on a scratch layer program over the context's own S-box pool, sharing a total budget of
+// FAST_TUNE_BUDGET_US. A candidate has to beat the current winner by FAST_TUNE_MARGIN_PERCENT to
+// displace it, so that timing noise does not overturn the registry order.
+//
+// Roles of a direction the pool has no tables for keep the kernels passed in.
+//
+// Choices can be cached in the text file named by the FAST_TUNE_CACHE environment variable, one
+// line per CPU model, parameter set, CPU tier, JIT setting and directions:
+//   <cpu model> TAB <radix> <length> <w> <w'> <layers> <sboxes> <tier> <jit|nojit> <enc|dec|both>
+//   TAB <encrypt> <decrypt> <encrypt batch> <decrypt batch>
+// The last matching line wins; one naming kernels that cannot be bound here is ignored.
+
+#define FAST_TUNE_BUDGET_US      20000U
+#define FAST_TUNE_MARGIN_PERCENT 3U
+#define FAST_TUNE_WORDS          64U
+// Word-layers per timed run: long programs get fewer words, down to one, to stay near the budget
+#define FAST_TUNE_WORK           (1U << 16)
+#define FAST_TUNE_MAX_REPS       1000U
+#define FAST_TUNE_MAX_CANDIDATES 32U
+#define FAST_TUNE_LINE_SIZE      512U
+
+typedef enum { ROLE_ENC, ROLE_DEC, ROLE_ENC_BATCH, ROLE_DEC_BATCH, ROLE_COUNT } role_t;
+
+typedef struct {
+    const fast_params_t *params;
+    const sbox_pool_t   *pool;
+    fast_cpu_tier_t      tier;
+    bool                 jit;
+} tune_target_t;
+
+static bool
+role_decrypts(role_t role)
+{
+    return role == ROLE_DEC || role == ROLE_DEC_BATCH;
+}
+
+// Whether the pool has the tables the role runs on
+static bool
+role_active(const tune_target_t *target, role_t role)
+{
+    return role_decrypts(role) ? target->pool->inv_slab != NULL
+                               : target->pool->perm_slab != NULL;
+}
+
+static bool
+role_batches(role_t role)
+{
+    return role == ROLE_ENC_BATCH || role == ROLE_DEC_BATCH;
+}
+
+static const fast_kernel_t **
+role_slot(fast_kernel_set_t *set, role_t role)
+{
+    switch (role) {
+    case ROLE_ENC:
+        return &set->enc;
+    case ROLE_DEC:
+        return &set->dec;
+    case ROLE_ENC_BATCH:
+        return &set->enc_batch;
+    default:
+        return &set->dec_batch;
+    }
+}
+
+// Kernels able to serve a role, in registry order, the JIT last
+static size_t
+candidates(const tune_target_t *target, role_t role, const fast_kernel_t **out)
+{
+    const bool                  decrypt  = role_decrypts(role);
+    const bool                  batch    = role_batches(role);
+    const fast_kernel_t *const *registry = decrypt ? fast_decrypt_kernels : fast_encrypt_kernels;
+    size_t                      count    = 0;
+
+    for (size_t i = 0; registry[i] && count < FAST_TUNE_MAX_CANDIDATES - 1; i++) {
+        const fast_kernel_t *k = registry[i];
+        if ((batch ? k->batch != NULL : k->run != NULL) && k->tier <= target->tier &&
+            k->supports(target->params, target->pool)) {
+            out[count++] = k;
+        }
+    }
+    if (target->jit && !batch && fast_jit_available(target->params)) {
+        out[count++] = decrypt ? &fast_jit_decrypt_kernel : &fast_jit_encrypt_kernel;
+    }
+    return count;
+}
+
+// Bytes per symbol of the words the kernels run on
+static size_t
+symbol_size(const fast_params_t *params)
+{
+    return params->radix > FAST_MAX_RADIX ? sizeof(uint16_t) : sizeof(uint8_t);
+}
+
+static double
+now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+// Scratch program over the whole pool, so that any candidate can run
+static int
+alloc_scratch(layer_program_t *prog, uint8_t **seq, const tune_target_t *target)
+{
+    const uint32_t layers = target->params->num_layers;
+    const uint32_t count  = target->params->sbox_count;
+    const size_t   entry  = seq_entry_size(count);
+
+    memset(prog, 0, sizeof(*prog));
+    *seq = malloc(layers * entry);
+    if (!*seq) {
+        return -1;
+    }
+    // Only the access pattern matters here, not the actual sequence of any tweak
+    for (uint32_t i = 0; i < layers; i++) {
+        const uint16_t sbox = (uint16_t) (((uint64_t) i * 167U + 13U) % count);
+        if (entry == sizeof(uint16_t)) {
+            memcpy(*seq + i * sizeof(sbox), &sbox, sizeof(sbox));
+        } else {
+            (*seq)[i] = (uint8_t) sbox;
+        }
+    }
+
+    return fast_compile_program(prog, target->pool, *seq, layers);
+}
+
+static void
+free_scratch(layer_program_t *prog, uint8_t *seq)
+{
+    fast_jit_release(prog);
+    free(seq);
+}
+
+// Best time of one run over the scratch words, repeated within the time slice
+static double
+time_kernel(const fast_kernel_t *k, bool batch, const fast_params_t *params,
+            const layer_program_t *prog, uint8_t *words, size_t count, double slice)
+{
+    const size_t   ell   = symbol_size(params) * params->word_length;
+    const double   start = now_seconds();
+    double         best  = 0.0;
+
+    // The first run warms up the tables and is not counted
+    for (uint32_t rep = 0; rep <= FAST_TUNE_MAX_REPS; rep++) {
+        const double t0 = now_seconds();
+        if (batch) {
+            k->batch(params, prog, words, count);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                k->run(params, prog, words + i * ell);
+            }
+        }
+        const double t1 = now_seconds();
+
+        if (rep > 0 && (rep == 1 || t1 - t0 < best)) {
+            best = t1 - t0;
+        }
+        if (rep > 0 && t1 - start >= slice) {
+            break;
+        }
+    }
+    return best;
+}
+
+static int
+benchmark(fast_kernel_set_t *set, const tune_target_t *target)
+{
+    const fast_params_t *params = target->params;
+    const fast_kernel_t *cands[ROLE_COUNT][FAST_TUNE_MAX_CANDIDATES];
+    size_t               counts[ROLE_COUNT];
+    size_t               total = 0;
+
+    for (int r = 0; r < ROLE_COUNT; r++) {
+        counts[r] = role_active(target, (role_t) r) ? candidates(target, (role_t) r, cands[r]) : 0;
+        if (counts[r] == 0 && role_active(target, (role_t) r)) {
+            return -1;
+        }
+        total += counts[r];
+    }
+
+    const size_t    count   = params->num_layers >= FAST_TUNE_WORK / FAST_TUNE_WORDS
+                                  ? (FAST_TUNE_WORK + params->num_layers - 1) / params->num_layers
+                                  : FAST_TUNE_WORDS;
+    const size_t    symbols = count * params->word_length;
+    layer_program_t prog;
+    uint8_t        *seq     = NULL;
+    uint8_t        *words   = malloc(symbols * symbol_size(params));
+    int             status  = -1;
+
+    if (!words || alloc_scratch(&prog, &seq, target) != 0) {
+        goto cleanup;
+    }
+    if (target->jit) {
+        (void) fast_jit_compile(&prog, params);
+    }
+    for (size_t i = 0; i < symbols; i++) {
+        const uint16_t symbol = (uint16_t) ((i * 7U + 3U) % params->radix);
+        if (symbol_size(params) == sizeof(uint16_t)) {
+            memcpy(words + i * sizeof(symbol), &symbol, sizeof(symbol));
+        } else {
+            words[i] = (uint8_t) symbol;
+        }
+    }
+
+    const double slice = FAST_TUNE_BUDGET_US * 1e-6 / (double) total;
+
+    for (int r = 0; r < ROLE_COUNT; r++) {
+        const fast_kernel_t *winner      = NULL;
+        double               winner_time = 0.0;
+
+        if (counts[r] == 0) {
+            continue;
+        }
+        for (size_t c = 0; c < counts[r]; c++) {
+            const double t = time_kernel(cands[r][c], role_batches((role_t) r), params, &prog,
+                                         words, count, slice);
+            if (!winner || t * (100.0 + FAST_TUNE_MARGIN_PERCENT) < winner_time * 100.0) {
+                winner      = cands[r][c];
+                winner_time = t;
+            }
+        }
+        *role_slot(set, (role_t) r) = winner;
+    }
+    status = 0;
+
+cleanup:
+    if (seq) {
+        free_scratch(&prog, seq);
+    }
+    free(words);
+    return status;
+}
+
+static void
+cache_key(char *key, size_t size, const tune_target_t *target)
+{
+    const fast_params_t *p   = target->params;
+    const bool           enc = role_active(target, ROLE_ENC);
+    const bool           dec = role_active(target, ROLE_DEC);
+    char                 model[FAST_CPU_MODEL_SIZE];
+
+    fast_cpu_model(model, sizeof(model));
+    snprintf(key, size, "%s\t%u %u %u %u %u %u %s %s %s\t", model, p->radix, p->word_length,
+             p->branch_dist1, p->branch_dist2, p->num_layers, p->sbox_count,
+             fast_cpu_tier_name(target->tier), target->jit ? "jit" : "nojit",
+             enc && dec ? "both" : enc ? "enc" : "dec");
+}
+
+static const fast_kernel_t *
+resolve(const tune_target_t *target, role_t role, const char *name)
+{
+    const fast_kernel_t *cands[FAST_TUNE_MAX_CANDIDATES];
+    const size_t         count = candidates(target, role, cands);
+
+    for (size_t c = 0; c < count; c++) {
+        if (strcmp(cands[c]->name, name) == 0) {
+            return cands[c];
+        }
+    }
+    return NULL;
+}
+
+static bool
+cache_lookup(fast_kernel_set_t *set, const tune_target_t *target, const char *path,
+             const char *key)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    const size_t key_len = strlen(key);
+    char         line[FAST_TUNE_LINE_SIZE];
+    bool         found = false;
+
+    while (fgets(line, sizeof(line), file)) {
+        char names[ROLE_COUNT][64];
+        if (strncmp(line, key, key_len) != 0 ||
+            sscanf(line + key_len, "%63s %63s %63s %63s", names[0], names[1], names[2],
+                   names[3]) != ROLE_COUNT) {
+            continue;
+        }
+
+        fast_kernel_set_t candidate;
+        bool              complete = true;
+        for (int r = 0; r < ROLE_COUNT && complete; r++) {
+            *role_slot(&candidate, (role_t) r) = resolve(target, (role_t) r, names[r]);
+            complete = *role_slot(&candidate, (role_t) r) != NULL;
+        }
+        if (complete) {
+            *set  = candidate;
+            found = true;
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+static void
+cache_store(const fast_kernel_set_t *set, const char *path, const char *key)
+{
+    FILE *file = fopen(path, "a");
+    if (!file) {
+        return;
+    }
+    fprintf(file, "%s%s %s %s %s\n", key, set->enc->name, set->dec->name, set->enc_batch->name,
+            set->dec_batch->name);
+    fclose(file);
+}
+
+int
+fast_autotune(fast_kernel_set_t *set, const fast_params_t *params, const sbox_pool_t *pool,
+              fast_cpu_tier_t tier, bool jit)
+{
+    const tune_target_t target = { params, pool, tier, jit };
+    const char         *path   = getenv("FAST_TUNE_CACHE");
+    char                key[FAST_TUNE_LINE_SIZE];
+
+    cache_key(key, sizeof(key), &target);
+
+    if (path && *path && cache_lookup(set, &target, path, key)) {
+        return 0;
+    }
+    if (benchmark(set, &target) != 0) {
+        return -1;
+    }
+    if (path && *path) {
+        cache_store(set, path, key);
+    }
+    return 0;
+}